@@ -27,6 +27,14 @@ inline SEXP attribute_hidden DT_subsetDT(SEXP x, SEXP rows, SEXP cols) {
        (SEXP(*)(SEXP,SEXP,SEXP)) R_GetCCallable("data.table", "DT_subsetDT");
      return fun(x,rows,cols);
 }
+// thread-safe group functions for GForce, see ?cdt; dll is the name in useDynLib() and R_init_<dll>, name the
+// routine's name as registered with R_registerRoutines()
+typedef double (*DT_groupfun_t)(const double **x, int ncol, int n);
+inline void attribute_hidden DT_register_groupfun(const char *dll, const char *name, DT_groupfun_t f) {
+     static void(*fun)(const char *, const char *, DT_groupfun_t) =
+       (void(*)(const char *, const char *, DT_groupfun_t)) R_GetCCallable("data.table", "DT_register_groupfun");
+     fun(dll, name, f);
+}
 // forder #4015
 // setalloccol alloccolwrapper setDT #4439
 
@@ -41,6 +49,7 @@ inline SEXP attribute_hidden DT_subsetDT(SEXP x, SEXP rows, SEXP cols) {
 /* add a namespace for C++ use */
 namespace dt {
   inline SEXP subsetDT(SEXP x, SEXP rows, SEXP cols) { return DT_subsetDT(x, rows, cols); }
+  inline void register_groupfun(const char *dll, const char *name, DT_groupfun_t f) { DT_register_groupfun(dll, name, f); }
 }
 
 #endif /* __cplusplus */
@@ -165,6 +165,9 @@ static SEXP shallow(SEXP dt, SEXP cols, R_len_t n)
   SEXP index = PROTECT(getAttrib(dt, sym_index)); protecti++;
   setAttrib(newdt, sym_index, shallow_duplicate(index));
 
+  SEXP bitmap = PROTECT(getAttrib(dt, sym_bitmap)); protecti++;
+  setAttrib(newdt, sym_bitmap, shallow_duplicate(bitmap));
+
   SEXP sorted = PROTECT(getAttrib(dt, sym_sorted)); protecti++;
   setAttrib(newdt, sym_sorted, duplicate(sorted));
 
@@ -326,6 +329,121 @@ SEXP selfrefokwrapper(SEXP x, SEXP verbose) {
 
 int *_Last_updated = NULL;
 
+/*
+  An index on columns that := or set() has assigned to a subset of rows is patched rather than dropped: the changed rows
+  are taken out of the order, sorted among themselves and merged back in, which is O(nrow + nchanged*log(nchanged)) and
+  much cheaper than forder when few rows change. Rows are compared as forder does for the index: column by column with
+  NA first and doubles via dtwiddle, ties by row number (forder is stable). Only integer, logical, double and integer64
+  columns are handled; NULL is returned otherwise and the index is dropped as before. Opt-in for now by
+  options(datatable.patch.index=TRUE).
+*/
+typedef struct { enum {IX_INT, IX_DOUBLE, IX_INT64} type; const void *p; } ixcol_t;
+
+// isTRUE(getOption("datatable.patch.index")); it's read after the columns have been assigned to, so any other value
+// means the index is dropped rather than an error leaving a stale index on the modified table
+static bool GetPatchIndex(void) {
+  SEXP opt = GetOption(install("datatable.patch.index"), R_NilValue);
+  return IS_TRUE(opt);
+}
+
+static inline int ixcmp(const ixcol_t *c, const int nc, const int a, const int b)
+{
+  for (int j=0; j<nc; ++j) {
+    switch(c[j].type) {
+    case IX_INT: {  // NA_INTEGER is INT_MIN so comes first
+      const int x=((const int *)c[j].p)[a], y=((const int *)c[j].p)[b];
+      if (x!=y) return x<y ? -1 : 1;
+    } break;
+    case IX_INT64: {
+      const int64_t x=((const int64_t *)c[j].p)[a], y=((const int64_t *)c[j].p)[b];
+      if (x!=y) return x<y ? -1 : 1;
+    } break;
+    default: {
+      const uint64_t x=dtwiddle(((const double *)c[j].p)[a]), y=dtwiddle(((const double *)c[j].p)[b]);
+      if (x!=y) return x<y ? -1 : 1;
+    }
+    }
+  }
+  return a<b ? -1 : a>b;
+}
+
+static SEXP patchIndex(SEXP dt, SEXP names, SEXP idx, const char *idxname, SEXP rows, const int nrow)
+{
+  if (length(idx)!=0 && length(idx)!=nrow) return R_NilValue;
+  // the index columns, from its name "__col1__col2"
+  int nc = 0;
+  ixcol_t *c = (ixcol_t *)R_alloc(strlen(idxname)/3+1, sizeof(ixcol_t));
+  for (const char *p=idxname; *p; ) {
+    if (p[0]!='_' || p[1]!='_') return R_NilValue;
+    p += 2;
+    const char *e = strstr(p, "__");
+    const size_t len = e ? (size_t)(e-p) : strlen(p);
+    int j = 0;
+    while (j<length(names) && (strlen(CHAR(STRING_ELT(names, j)))!=len || strncmp(CHAR(STRING_ELT(names, j)), p, len))) j++;
+    if (j==length(names)) return R_NilValue;
+    SEXP col = VECTOR_ELT(dt, j);
+    switch(TYPEOF(col)) {
+    case LGLSXP: case INTSXP: c[nc].type = IX_INT; c[nc].p = INTEGER_RO(col); break;
+    case REALSXP: c[nc].type = INHERITS(col, char_integer64) ? IX_INT64 : IX_DOUBLE; c[nc].p = REAL_RO(col); break;
+    default: return R_NilValue;
+    }
+    nc++;
+    p += len;
+  }
+  // the distinct changed rows, sorted by their new values
+  const int *rowsd = INTEGER(rows), nr = length(rows);
+  char *changed = (char *)R_alloc(nrow, sizeof(char));
+  memset(changed, 0, nrow);
+  int *ch = (int *)R_alloc(nr, sizeof(int)), *tmp = (int *)R_alloc(nr, sizeof(int)), nch = 0;
+  bool anyna = false, anyinfnan = false;
+  for (int i=0; i<nr; ++i) {
+    const int k = rowsd[i]-1;
+    if (rowsd[i]<1 || changed[k]) continue;  // NA and 0 weren't assigned
+    changed[k] = 1;
+    ch[nch++] = k;
+    for (int j=0; j<nc; ++j) {
+      if (c[j].type==IX_INT) anyna |= ((const int *)c[j].p)[k]==NA_INTEGER;
+      else if (c[j].type==IX_INT64) anyna |= ((const int64_t *)c[j].p)[k]==NA_INTEGER64;
+      else { const double v = ((const double *)c[j].p)[k]; anyna |= ISNA(v); anyinfnan |= !R_FINITE(v) && !ISNA(v); }
+    }
+  }
+  for (int w=1; w<nch; w*=2) {
+    for (int lo=0; lo<nch; lo+=2*w) {
+      const int mid = MIN(lo+w, nch), hi = MIN(lo+2*w, nch);
+      int a=lo, b=mid, t=lo;
+      while (a<mid && b<hi) tmp[t++] = ixcmp(c, nc, ch[b], ch[a])<0 ? ch[b++] : ch[a++];
+      while (a<mid) tmp[t++] = ch[a++];
+      while (b<hi) tmp[t++] = ch[b++];
+    }
+    memcpy(ch, tmp, nch*sizeof(int));
+  }
+  // merge them into the order of the unchanged rows; an index of length 0 means the rows were in order already
+  const int *old = length(idx) ? INTEGER_RO(idx) : NULL;
+  SEXP ans = PROTECT(allocVector(INTSXP, nrow));
+  int *o = INTEGER(ans);
+  bool sorted = true;
+  for (int w=0, a=0, b=0; w<nrow; ++w) {
+    while (a<nrow && changed[old ? old[a]-1 : a]) a++;
+    const int ra = a<nrow ? (old ? old[a]-1 : a) : -1;
+    o[w] = (ra>=0 && (b==nch || ixcmp(c, nc, ra, ch[b])<0)) ? (a++, ra+1) : ch[b++]+1;
+    sorted &= o[w]==w+1;
+  }
+  if (sorted) {
+    UNPROTECT(1);
+    ans = PROTECT(allocVector(INTSXP, 0));
+  }
+  // group starts have moved so are not kept; forder recomputes them when wanted. The NA counts can only become stale in
+  // the safe direction: an NA overwritten may leave anyna set, which just stops the index being used for na.last=TRUE
+  if (!isNull(getAttrib(idx, sym_anyna))) {
+    setAttrib(ans, sym_anyna, ScalarInteger(INTEGER(getAttrib(idx, sym_anyna))[0] || anyna));
+    setAttrib(ans, sym_anyinfnan, ScalarInteger(INTEGER(getAttrib(idx, sym_anyinfnan))[0] || anyinfnan));
+    setAttrib(ans, sym_anynotascii, getAttrib(idx, sym_anynotascii));
+    setAttrib(ans, sym_anynotutf8, getAttrib(idx, sym_anynotutf8));
+  }
+  UNPROTECT(1);
+  return ans;
+}
+
 SEXP assign(SEXP dt, SEXP rows, SEXP cols, SEXP newcolnames, SEXP values)
 {
   // For internal use only by := in [.data.table, and set()
@@ -680,8 +798,13 @@ SEXP assign(SEXP dt, SEXP rows, SEXP cols, SEXP newcolnames, SEXP values)
         }
         free(s5);
       }
+      SEXP patched = newKeyLength < strlen(c1) && !isNull(rows) && GetPatchIndex() ? patchIndex(dt, names, CAR(s), c1, rows, nrow) : R_NilValue;
       memset(s4 + newKeyLength, '\0', 1); // truncate the new key to the new length
-      if(newKeyLength == 0){ // no valid key column remains. Drop the key
+      if (!isNull(patched)) { // only some rows were assigned to: the index is kept, updated for those rows
+        SETCAR(s, patched);
+        if (verbose)
+          Rprintf(_("Patching index '%s' for the %d rows updated\n"), c1+2, numToDo);
+      } else if(newKeyLength == 0){ // no valid key column remains. Drop the key
         setAttrib(index, a, R_NilValue);
         SET_STRING_ELT(indexNames, indexNo, NA_STRING);
         if (verbose) {
@@ -710,6 +833,20 @@ SEXP assign(SEXP dt, SEXP rows, SEXP cols, SEXP newcolnames, SEXP values)
       s = CDR(s);
     }
   }
+  SEXP bitmap = getAttrib(dt, sym_bitmap);
+  if (!isNull(bitmap)) {
+    // a bitmap index is on one column, "__col" as an index would be, so is dropped when any of its rows are assigned to
+    for (int i=0; i<LENGTH(assignedNames); ++i) {
+      const char *col = CHAR(STRING_ELT(assignedNames, i));
+      char *nm = R_alloc(strlen(col)+3, sizeof(char));
+      snprintf(nm, strlen(col)+3, "__%s", col);
+      SEXP sym = install(nm);
+      if (isNull(getAttrib(bitmap, sym))) continue;
+      setAttrib(bitmap, sym, R_NilValue);
+      if (verbose)
+        Rprintf(_("Dropping bitmap index '%s' due to an update on its column\n"), col);
+    }
+  }
   if (ndelete) {
     // delete any columns assigned NULL (there was a 'continue' earlier in loop above)
     int *tt = (int *)R_alloc(ndelete, sizeof(int));
@@ -0,0 +1,198 @@
+#include "data.table.h"
+
+/*
+  Bitmap indices: for each value of a low cardinality column, a compressed bitmap of the rows holding it. A filter
+  such as DT[a=="x" & b %in% c("y","z")] is then the OR of the bitmaps of the values matched in each column, ANDed
+  across the columns, without looking at the columns themselves.
+
+  The layout follows Roaring bitmaps. The rows are split into chunks of 65536 and each chunk a value occurs in has a
+  container: a sorted array of the 16 bit offsets of its rows within the chunk when there are few, otherwise a bitset
+  of the whole chunk. A bitmap is a raw vector holding the number of containers, a header per container in chunk
+  order, then the containers themselves, each at an offset that's a multiple of 8 so that bitsets can be read as words.
+  The bitmaps are native endian; they are an in-memory structure like indices and not meant to be moved between
+  machines.
+*/
+
+#define BM_CHUNK    65536
+#define BM_WORDS    1024   // 64-bit words in a bitset container
+#define BM_MAXARRAY 4096   // more rows than this in a chunk and a bitset (8KB) is smaller than an array of uint16
+
+typedef struct {
+  uint32_t key;   // chunk number
+  uint32_t card;  // number of rows in the chunk with the value
+  uint64_t off;   // byte offset of the container from the start of the bitmap
+} bmhead_t;
+
+static inline size_t cont_bytes(const uint32_t card)
+{
+  return card>BM_MAXARRAY ? BM_WORDS*sizeof(uint64_t) : ((size_t)card*sizeof(uint16_t) + 7) & ~(size_t)7;
+}
+
+static inline int popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(x);
+#else
+  int n = 0;
+  for (; x; x &= x-1) n++;
+  return n;
+#endif
+}
+
+static inline int ctz64(const uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!((x>>n) & 1)) n++;
+  return n;
+#endif
+}
+
+SEXP bitmapBuild(SEXP g, SEXP ngArg)
+{
+  // g: the value number of each row, 1..ng
+  if (!isInteger(g)) internal_error(__func__, "passed g of type %s", type2char(TYPEOF(g))); // # nocov
+  if (!isInteger(ngArg) || LENGTH(ngArg)!=1 || INTEGER(ngArg)[0]<0) internal_error(__func__, "passed an invalid ng"); // # nocov
+  const int n = LENGTH(g), ng = INTEGER(ngArg)[0], nchunk = n ? (n-1)/BM_CHUNK+1 : 0;
+  const int *gd = INTEGER(g);
+  for (int i=0; i<n; ++i)
+    if (gd[i]<1 || gd[i]>ng) internal_error(__func__, "g[%d]=%d is not in [1,%d]", i+1, gd[i], ng); // # nocov
+  // 1. the size of each value's bitmap
+  int *cnt = (int *)R_alloc(ng, sizeof(int)), *ncont = (int *)R_alloc(ng, sizeof(int));
+  size_t *bytes = (size_t *)R_alloc(ng, sizeof(size_t));
+  memset(ncont, 0, ng*sizeof(int));
+  memset(bytes, 0, ng*sizeof(size_t));
+  for (int c=0; c<nchunk; ++c) {
+    const int from = c*BM_CHUNK, to = MIN(from+BM_CHUNK, n);
+    memset(cnt, 0, ng*sizeof(int));
+    for (int i=from; i<to; ++i) cnt[gd[i]-1]++;
+    for (int v=0; v<ng; ++v) if (cnt[v]) { ncont[v]++; bytes[v] += cont_bytes(cnt[v]); }
+  }
+  SEXP ans = PROTECT(allocVector(VECSXP, ng));
+  uint8_t **base = (uint8_t **)R_alloc(ng, sizeof(uint8_t *));
+  int *nhead = (int *)R_alloc(ng, sizeof(int));
+  uint64_t *pos = (uint64_t *)R_alloc(ng, sizeof(uint64_t));
+  for (int v=0; v<ng; ++v) {
+    const size_t head = sizeof(uint64_t) + (size_t)ncont[v]*sizeof(bmhead_t);
+    SET_VECTOR_ELT(ans, v, allocVector(RAWSXP, head + bytes[v]));
+    base[v] = RAW(VECTOR_ELT(ans, v));
+    memset(base[v], 0, head + bytes[v]);
+    *(uint64_t *)base[v] = ncont[v];
+    nhead[v] = 0;
+    pos[v] = head;
+  }
+  // 2. fill the containers, chunk by chunk
+  int *fill = (int *)R_alloc(ng, sizeof(int));
+  for (int c=0; c<nchunk; ++c) {
+    const int from = c*BM_CHUNK, to = MIN(from+BM_CHUNK, n);
+    memset(cnt, 0, ng*sizeof(int));
+    for (int i=from; i<to; ++i) cnt[gd[i]-1]++;
+    for (int v=0; v<ng; ++v) {
+      if (!cnt[v]) continue;
+      bmhead_t *h = (bmhead_t *)(base[v] + sizeof(uint64_t)) + nhead[v]++;
+      h->key = c; h->card = cnt[v]; h->off = pos[v];
+      fill[v] = 0;
+    }
+    for (int i=from; i<to; ++i) {
+      const int v = gd[i]-1;
+      const bmhead_t *h = (const bmhead_t *)(base[v] + sizeof(uint64_t)) + nhead[v]-1;
+      const int r = i-from;
+      if (h->card>BM_MAXARRAY) ((uint64_t *)(base[v] + h->off))[r>>6] |= (uint64_t)1 << (r&63);
+      else ((uint16_t *)(base[v] + h->off))[fill[v]++] = (uint16_t)r;
+    }
+    for (int v=0; v<ng; ++v) if (cnt[v]) pos[v] += cont_bytes(cnt[v]);
+  }
+  UNPROTECT(1);
+  return ans;
+}
+
+// the container of bitmap b for chunk key, or NULL if none of its rows are in that chunk
+static inline const bmhead_t *find_cont(const uint8_t *b, const uint32_t key)
+{
+  const bmhead_t *h = (const bmhead_t *)(b + sizeof(uint64_t));
+  int lo = 0, hi = (int)*(const uint64_t *)b - 1;
+  while (lo<=hi) {
+    const int mid = lo + (hi-lo)/2;
+    if (h[mid].key==key) return h+mid;
+    if (h[mid].key<key) lo = mid+1; else hi = mid-1;
+  }
+  return NULL;
+}
+
+SEXP bitmapWhich(SEXP conds, SEXP nrowArg)
+{
+  // conds: a list of conditions, each a list of the bitmaps of the values it matches. The rows in any bitmap of every
+  // condition are returned, in increasing order
+  if (!isNewList(conds) || !LENGTH(conds)) internal_error(__func__, "passed an empty or non-list conds"); // # nocov
+  if (!isInteger(nrowArg) || LENGTH(nrowArg)!=1 || INTEGER(nrowArg)[0]<0) internal_error(__func__, "passed an invalid nrow"); // # nocov
+  const int n = INTEGER(nrowArg)[0], nchunk = n ? (n-1)/BM_CHUNK+1 : 0, ncond = LENGTH(conds);
+  // pointers to the bitmaps taken up front so that no R API is called from the threads
+  int *condStart = (int *)R_alloc(ncond+1, sizeof(int));
+  condStart[0] = 0;
+  for (int j=0; j<ncond; ++j) {
+    SEXP cj = VECTOR_ELT(conds, j);
+    if (!isNewList(cj)) internal_error(__func__, "condition %d is not a list", j+1); // # nocov
+    condStart[j+1] = condStart[j] + LENGTH(cj);
+  }
+  const uint8_t **bm = (const uint8_t **)R_alloc(condStart[ncond], sizeof(uint8_t *));
+  for (int j=0, k=0; j<ncond; ++j) {
+    SEXP cj = VECTOR_ELT(conds, j);
+    for (int b=0; b<LENGTH(cj); ++b) {
+      if (TYPEOF(VECTOR_ELT(cj, b))!=RAWSXP) internal_error(__func__, "passed a bitmap that isn't raw"); // # nocov
+      bm[k++] = RAW(VECTOR_ELT(cj, b));
+    }
+  }
+  uint64_t *words = (uint64_t *)R_alloc((size_t)nchunk*BM_WORDS, sizeof(uint64_t));
+  int *cnt = (int *)R_alloc(nchunk+1, sizeof(int));
+  #pragma omp parallel for num_threads(getDTthreads(nchunk, false)) schedule(dynamic)
+  for (int c=0; c<nchunk; ++c) {
+    uint64_t *acc = words + (size_t)c*BM_WORDS, tmp[BM_WORDS];
+    bool empty = false;
+    for (int j=0; j<ncond && !empty; ++j) {
+      // the OR of this condition's bitmaps for the chunk, straight into acc for the first condition
+      uint64_t *out = j ? tmp : acc;
+      memset(out, 0, BM_WORDS*sizeof(uint64_t));
+      bool any = false;
+      for (int k=condStart[j]; k<condStart[j+1]; ++k) {
+        const bmhead_t *h = find_cont(bm[k], c);
+        if (!h) continue;
+        any = true;
+        if (h->card>BM_MAXARRAY) {
+          const uint64_t *bits = (const uint64_t *)(bm[k] + h->off);
+          for (int w=0; w<BM_WORDS; ++w) out[w] |= bits[w];
+        } else {
+          const uint16_t *arr = (const uint16_t *)(bm[k] + h->off);
+          for (uint32_t i=0; i<h->card; ++i) out[arr[i]>>6] |= (uint64_t)1 << (arr[i]&63);
+        }
+      }
+      if (!any) { empty = true; break; }
+      if (j) {
+        uint64_t nz = 0;
+        for (int w=0; w<BM_WORDS; ++w) nz |= (acc[w] &= tmp[w]);
+        empty = !nz;
+      }
+    }
+    int count = 0;
+    if (empty) memset(acc, 0, BM_WORDS*sizeof(uint64_t));
+    else for (int w=0; w<BM_WORDS; ++w) count += popcount64(acc[w]);
+    cnt[c] = count;
+  }
+  // cumulate the counts into each chunk's position in the result
+  int total = 0;
+  for (int c=0; c<nchunk; ++c) { const int tt = cnt[c]; cnt[c] = total; total += tt; }
+  SEXP ans = PROTECT(allocVector(INTSXP, total));
+  int *ansd = INTEGER(ans);
+  #pragma omp parallel for num_threads(getDTthreads(nchunk, false))
+  for (int c=0; c<nchunk; ++c) {
+    const uint64_t *acc = words + (size_t)c*BM_WORDS;
+    int *out = ansd + cnt[c];
+    for (int w=0; w<BM_WORDS; ++w) {
+      for (uint64_t word=acc[w]; word; word &= word-1)
+        *out++ = c*BM_CHUNK + w*64 + ctz64(word) + 1;
+    }
+  }
+  UNPROTECT(1);
+  return ans;
+}
@@ -19,7 +19,7 @@ static SEXP chmatchMain(SEXP x, SEXP table, int nomatch, bool chin, bool chmatch
       error(_("x is type '%s' (must be 'character' or NULL)"), type2char(TYPEOF(x)));
     }
   }
-  // allocations up front before savetl starts in case allocs fail
+  // R allocations up front, before the hash table which must be freed before any error
   int nprotect=0;
   SEXP ans = PROTECT(allocVector(chin?LGLSXP:INTSXP, xlen)); nprotect++;
   if (xlen==0) { // no need to look at table when x is empty (including null)
@@ -36,12 +36,11 @@ static SEXP chmatchMain(SEXP x, SEXP table, int nomatch, bool chin, bool chmatch
   }
   // Since non-ASCII strings may be marked with different encodings, it only make sense to compare
   // the bytes under a same encoding (UTF-8) #3844 #3850.
-  // Not 'const' because we might SET_TRUELENGTH() below.
-  SEXP *xd;
+  const SEXP *xd;
   if (isSymbol(x)) {
     xd = &sym;
   } else {
-    xd = (SEXP *)STRING_PTR_RO(PROTECT(coerceUtf8IfNeeded(x))); nprotect++;
+    xd = STRING_PTR_RO(PROTECT(coerceUtf8IfNeeded(x))); nprotect++;
   }
   const SEXP *td = STRING_PTR_RO(PROTECT(coerceUtf8IfNeeded(table))); nprotect++;
   if (xlen==1) {
@@ -56,85 +55,66 @@ static SEXP chmatchMain(SEXP x, SEXP table, int nomatch, bool chin, bool chmatch
     return ans;
   }
   // else xlen>1; nprotect is const above since no more R allocations should occur after this point
-  savetl_init();
-  for (int i=0; i<xlen; i++) {
-    SEXP s = xd[i];
-    const int tl = TRUELENGTH(s);
-    if (tl>0) {
-      savetl(s);  // R's internal hash (which is positive); save it
-      SET_TRUELENGTH(s,0);
-    } else if (tl<0) {
-      // R 2.14.0+ initializes truelength to 0 (before that it was uninitialized/random).
-      // Now that data.table depends on R 3.1.0+, that is after 2.14.0 too.
-      // We rely on that 0-initialization, and that R's internal hash is positive.
-      // # nocov start
-      savetl_end();
-      internal_error(__func__, "CHARSXP '%s' has a negative truelength (%d)", CHAR(s), tl); // # nocov
-      // # nocov end
-    }
-  }
-  int nuniq=0;
-  for (int i=0; i<tablelen; ++i) {
-    const SEXP s = td[i];
-    int tl = TRUELENGTH(s);
-    if (tl>0) { savetl(s); tl=0; }
-    if (tl==0) SET_TRUELENGTH(s, chmatchdup ? -(++nuniq) : -i-1); // first time seen this string in table
-  }
-  // in future if we need NAs in x not to be matched to NAs in table ...
-  // if (!matchNAtoNA && TRUELENGTH(NA_STRING)<0)
-  //   SET_TRUELENGTH(NA_STRING, 0);
+  // Each distinct string in table maps to 1+its first position. This used to be stored in the TRUELENGTH of the CHARSXP
+  // which needed savetl() and meant nothing else could use TRUELENGTH meanwhile; a private hash table doesn't.
+  hashtab_t *h = hash_build(td, tablelen);
+  if (!h) error(_("Failed to allocate hash table in chmatch: length(table)=%d"), tablelen); // # nocov
+  // in future if we need NAs in x not to be matched to NAs in table, skip NA_STRING in x here
   if (chmatchdup) {
     // chmatchdup() is basically base::pmatch() but without the partial matching part. For example :
     //   chmatchdup(c("a", "a"), c("a", "a"))   # 1,2  - the second 'a' in 'x' has a 2nd match in 'table'
     //   chmatchdup(c("a", "a"), c("a", "b"))   # 1,NA - the second one doesn't 'see' the first 'a'
     //   chmatchdup(c("a", "a"), c("a", "a.1")) # 1,NA - differs from 'pmatch' output = 1,2
     // Used to be called chmatch2 before v1.12.2 and was in rbindlist.c. New implementation from 1.12.2 here in chmatch.c
-    // If nuniq==tablelen then there are no dups in table but we still need this branch because there might be dups
-    //   in x and the 2nd onwards of any dup needs to return NA
+    // Positions in table holding the same string are linked in order through next[], and cur[] at the first position
+    // of each string is the next one not yet matched. So each x takes the next unused dup, and NA once they're used up.
     // See end of file for benchmark
-    //                                                                                        uniq         dups
-    // For example: A,B,C,B,D,E,A,A   =>   A(TL=1),B(2),C(3),D(4),E(5)   =>   dupMap    1  2  3  5  6 | 8  7  4
-    //                                                                        dupLink   7  8          |    6     (blank=0)
-    unsigned int mapsize = tablelen+nuniq; // lto compilation warning #5760 // +nuniq to store a 0 at the end of each group
-    int *counts = (int *)calloc(nuniq, sizeof(int));
-    int *map =    (int *)calloc(mapsize, sizeof(int));
-    if (!counts || !map) {
+    // For example: A,B,C,B,D,E,A,A   =>   A: 1->7->8, B: 2->4, C: 3, D: 5, E: 6   (1-based positions linked by next[])
+    int *next = (int *)malloc((size_t)tablelen*sizeof(int));
+    int *cur =  (int *)malloc((size_t)tablelen*sizeof(int));
+    if (!next || !cur) {
       // # nocov start
-      free(counts); free(map);
-      for (int i=0; i<tablelen; i++) SET_TRUELENGTH(td[i], 0);
-      savetl_end();
-      error(_("Failed to allocate %"PRIu64" bytes working memory in chmatchdup: length(table)=%d length(unique(table))=%d"), ((uint64_t)tablelen*2+nuniq)*sizeof(int), tablelen, nuniq);
+      free(next); free(cur); hash_free(h);
+      error(_("Failed to allocate %"PRIu64" bytes working memory in chmatchdup: length(table)=%d"), (uint64_t)tablelen*2*sizeof(int), tablelen);
       // # nocov end
     }
-    for (int i=0; i<tablelen; ++i) counts[-TRUELENGTH(td[i])-1]++;
-    for (int i=0, sum=0; i<nuniq; ++i) { int tt=counts[i]; counts[i]=sum; sum+=tt+1; }
-    for (int i=0; i<tablelen; ++i) map[counts[-TRUELENGTH(td[i])-1]++] = i+1;           // 0 is left ending each group thanks to the calloc
-    for (int i=0, last=0; i<nuniq; ++i) {int tt=counts[i]+1; counts[i]=last; last=tt;}  // rewind counts to the beginning of each group
+    // the probes are done in parallel first, leaving just the cheap linking and taking of dups in order to one thread
+    #pragma omp parallel for num_threads(getDTthreads(tablelen, true))
+    for (int i=0; i<tablelen; ++i) next[i] = hash_lookup(h, td[i], 0)-1;  // first position of this string
+    for (int i=0; i<tablelen; ++i) {
+      const int f = next[i];  // cur[f] is the last position of this string seen so far
+      if (f!=i) { next[cur[f]] = i; cur[i] = -1; }  // cur[] is only used at the first position of each string
+      cur[f] = i;
+      next[i] = -1;
+    }
+    for (int i=0; i<tablelen; ++i) if (cur[i]!=-1) cur[i] = i;  // rewind to the first
+    #pragma omp parallel for num_threads(getDTthreads(xlen, true))
+    for (int i=0; i<xlen; ++i) ansd[i] = hash_lookup(h, xd[i], 0)-1;
     for (int i=0; i<xlen; ++i) {
-      int u = TRUELENGTH(xd[i]);
-      if (u<0) {
-        const int w = counts[-u-1]++;
-        if (map[w]) { ansd[i]=map[w]; continue; }
-        SET_TRUELENGTH(xd[i],0); // w falls on ending 0 marker: dups used up; any more dups should return nomatch
-        // we still need the 0-setting loop at the end of this function because often there will be some values in table that are not matched to at all.
+      const int f = ansd[i];
+      if (f>=0 && cur[f]>=0) {
+        ansd[i] = cur[f]+1;
+        cur[f] = next[cur[f]];  // -1 when dups used up; any more dups return nomatch
+      } else {
+        ansd[i] = nomatch;
       }
-      ansd[i] = nomatch;
     }
-    free(counts);
-    free(map);
+    free(next);
+    free(cur);
   } else if (chin) {
+    // the table is only read from here, so x is split across threads
+    #pragma omp parallel for num_threads(getDTthreads(xlen, true))
     for (int i=0; i<xlen; i++) {
-      ansd[i] = TRUELENGTH(xd[i])<0;
+      ansd[i] = hash_lookup(h, xd[i], 0)>0;
     }
   } else {
+    #pragma omp parallel for num_threads(getDTthreads(xlen, true))
     for (int i=0; i<xlen; i++) {
-      const int m = TRUELENGTH(xd[i]);
-      ansd[i] = (m<0) ? -m : nomatch;
+      const int m = hash_lookup(h, xd[i], 0);
+      ansd[i] = m ? m : nomatch;
     }
   }
-  for (int i=0; i<tablelen; i++)
-    SET_TRUELENGTH(td[i], 0);  // reinstate 0 rather than leave the -i-1
-  savetl_end();
+  hash_free(h);
   UNPROTECT(nprotect);  // ans, xd, td
   return ans;
 }
@@ -97,6 +97,7 @@ extern SEXP char_maxString;
 extern SEXP char_AsIs;
 extern SEXP sym_sorted;
 extern SEXP sym_index;
+extern SEXP sym_bitmap;
 extern SEXP sym_BY;
 extern SEXP sym_starts, char_starts;
 extern SEXP sym_maxgrpn;
@@ -123,6 +124,14 @@ extern size_t __typeorder[100]; // __ prefix otherwise if we use these names dir
 long long DtoLL(double x);
 double LLtoD(long long x);
 int GetVerbose(void);
+bool GetDeterministic(void);
+// Kahan-Neumaier compensated addition of v to the sum s with compensation term c, in double. Used when
+// options(datatable.deterministic=TRUE) instead of long double, whose precision differs by platform. A product must be
+// stored through a volatile before it's added, as in dvariance: compilers may contract a*b+c into a fused multiply-add
+// even across statements (gcc's default -ffp-contract=fast), so a plain variable isn't enough. The other kernels using
+// it (gsum, gmean, frolldet, fastmean) add no products.
+#define DSUM_ADD(s, c, v) do { const double t_ = (s) + (v); (c) += fabs(s)>=fabs(v) ? ((s)-t_)+(v) : ((v)-t_)+(s); (s) = t_; } while(0)
+#define DSUM_GET(s, c) (R_FINITE(s) ? (s)+(c) : (s))
 
 // cj.c
 SEXP cj(SEXP base_list);
@@ -165,6 +174,28 @@ SEXP vecseq(SEXP x, SEXP len, SEXP clamp);
 SEXP uniqlist(SEXP l, SEXP order);
 SEXP uniqlengths(SEXP x, SEXP n);
 
+// hashgroup.c
+uint64_t mix64(uint64_t h);
+SEXP hashgroup(SEXP l, SEXP forceArg);
+
+// hash.c
+typedef struct hashtab hashtab_t;
+hashtab_t *hash_create(size_t n);
+hashtab_t *hash_build(const SEXP *keys, int n);
+bool hash_set(hashtab_t *h, SEXP key, int value);
+int hash_lookup(const hashtab_t *h, SEXP key, int ifnotfound);
+int hash_keys(const hashtab_t *h, SEXP *out);
+void hash_free(hashtab_t *h);
+SEXP colhash(SEXP);
+
+// bitmap.c
+SEXP bitmapBuild(SEXP, SEXP);
+SEXP bitmapWhich(SEXP, SEXP);
+
+// gsumm.c
+typedef double (*DT_groupfun_t)(const double **x, int ncol, int n);  // as in inst/include/datatableAPI.h
+void DT_register_groupfun(const char *dll, const char *name, DT_groupfun_t fun);
+
 // chmatch.c
 SEXP chmatch(SEXP x, SEXP table, int nomatch);
 SEXP chin(SEXP x, SEXP table);
@@ -200,6 +231,8 @@ SEXP bmerge(SEXP idt, SEXP xdt, SEXP icolsArg, SEXP xcolsArg,
 double dquickselect(double *x, int n);
 double iquickselect(int *x, int n);
 double i64quickselect(int64_t *x, int n);
+double dquantile(double *x, int n, double p);
+double iquantile(int *x, int n, double p);
 
 // fread.c
 double wallclock(void);
@@ -217,6 +250,7 @@ void frollsum(unsigned int algo, double *x, uint64_t nx, ans_t *ans, int k, int
 void frollsumFast(double *x, uint64_t nx, ans_t *ans, int k, double fill, bool narm, int hasna, bool verbose);
 void frollsumExact(double *x, uint64_t nx, ans_t *ans, int k, double fill, bool narm, int hasna, bool verbose);
 void frollapply(double *x, int64_t nx, double *w, int k, ans_t *ans, int align, double fill, SEXP call, SEXP rho, bool verbose);
+void frolldet(bool mean, double *x, uint64_t nx, ans_t *ans, int kk, const int *k, double fill, bool narm);
 
 // frolladaptive.c
 void fadaptiverollmean(unsigned int algo, double *x, uint64_t nx, ans_t *ans, int *k, double fill, bool narm, int hasna, bool verbose);
@@ -266,6 +300,8 @@ void internal_error(const char *call_name, const char *format, ...);
 char *end(char *start);
 void ansMsg(ans_t *ans, int n, bool verbose, const char *func);
 SEXP testMsgR(SEXP status, SEXP x, SEXP k);
+SEXP test_sumsq(SEXP x);
+SEXP test_register_groupfun(void);
 
 //fifelse.c
 SEXP fifelseR(SEXP l, SEXP a, SEXP b, SEXP na);
@@ -325,6 +361,14 @@ SEXP anyNA(SEXP, SEXP);
 SEXP setlevels(SEXP, SEXP, SEXP);
 SEXP rleid(SEXP, SEXP);
 SEXP gmedian(SEXP, SEXP);
+SEXP gquantile(SEXP, SEXP, SEXP);
+SEXP guniqueN(SEXP, SEXP, SEXP);
+SEXP gnative(SEXP, SEXP, SEXP);
+SEXP gfroll(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP gcum(SEXP, SEXP);
+SEXP grank(SEXP, SEXP, SEXP);
+SEXP gtopk(SEXP, SEXP, SEXP, SEXP);
+SEXP groupfunRegistered(SEXP, SEXP);
 SEXP gtail(SEXP, SEXP);
 SEXP ghead(SEXP, SEXP);
 SEXP glast(SEXP);
@@ -340,7 +384,7 @@ SEXP nestedid(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP setDTthreads(SEXP, SEXP, SEXP, SEXP);
 SEXP getDTthreads_R(SEXP);
 SEXP nqRecreateIndices(SEXP, SEXP, SEXP, SEXP, SEXP);
-SEXP fsort(SEXP, SEXP);
+SEXP fsort(SEXP, SEXP, SEXP, SEXP);
 SEXP inrange(SEXP, SEXP, SEXP, SEXP);
 SEXP hasOpenMP(void);
 SEXP beforeR340(void);
@@ -26,6 +26,29 @@ tests run under R CMD check and run on all CRAN platforms daily to catch
 if we become out of line to base R (say if base R changed its mean).
 */
 
+/*
+With options(datatable.deterministic=TRUE) the sum is done in double with Kahan-Neumaier compensation (see DSUM_ADD)
+rather than in long double, whose precision differs by platform, so that the result is the same on every platform. The
+compensated sum is already accurate to about the last bit so the correcting second pass below is not done; the result is then
+not always identical to base::mean.
+*/
+static double fastmean_det(SEXP x, Rboolean narm)
+{
+  const int l = LENGTH(x);
+  const bool isInt = !isReal(x);
+  const int *xi = isInt ? INTEGER(x) : NULL;
+  const double *xd = isInt ? NULL : REAL(x);
+  double s=0., sc=0.;
+  int n = 0;
+  for (int i=0; i<l; ++i) {
+    const double v = isInt ? (xi[i]==NA_INTEGER ? NA_REAL : xi[i]) : xd[i];
+    if (ISNAN(v)) { if (narm) continue; return isInt ? NA_REAL : v; }
+    DSUM_ADD(s, sc, v);
+    n++;
+  }
+  return n ? DSUM_GET(s, sc)/n : R_NaN;
+}
+
 SEXP fastmean(SEXP args)
 {
   long double s = 0., t = 0.;
@@ -45,6 +68,11 @@ SEXP fastmean(SEXP args)
     error(_("fastmean was passed type %s, not numeric or logical"), type2char(TYPEOF(x)));
   }
   l = LENGTH(x);
+  if (GetDeterministic()) {
+    REAL(ans)[0] = fastmean_det(x, narm);
+    UNPROTECT(1);
+    return(ans);
+  }
   if (narm) {
     switch(TYPEOF(x)) {
     case LGLSXP:
@@ -18,7 +18,8 @@
     finds unique bytes to save 256 sweeping
     skips already-grouped yet unsorted
     recursive group gathering for cache efficiency
-    reuses R's global character cache (truelength on CHARSXP)
+    strings are hashed by their address in R's global character cache (hash.c)
+    input that is a few sorted runs, e.g. a keyed table with rows appended, is merged rather than radix sorted
     compressed column can cross byte boundaries to use spare bits (e.g. 2 16-level columns in one byte)
     just the remaining part of key is reordered as the radix progresses
     columnar byte-key for within-radix MT cache efficiency
@@ -46,6 +47,7 @@ static uint8_t *UGRP=NULL;          // 256 bytes for each thread; used by counti
 static int  *cradix_counts = NULL;
 static SEXP *cradix_xtmp   = NULL;
 static SEXP *ustr = NULL;
+static hashtab_t *ustr_hash = NULL;  // group number of each unique string, fetched by WRITE_KEY
 static int ustr_alloc = 0;
 static int ustr_n = 0;
 static int ustr_maxlen = 0;
@@ -64,15 +66,14 @@ static char msg[1001];
 #undef warning
 #define warning(...) Do not use warning in this file                // since it can be turned to error via warn=2
 /* Using OS realloc() in this file to benefit from (often) in-place realloc() to save copy
- * We have to trap on exit anyway to call savetl_end().
+ * We have to trap on exit anyway to free the hash table of unique strings.
  * NB: R_alloc() would be more convenient (fails within) and robust (auto free) but there is no R_realloc(). Implementing R_realloc() would be an alloc and copy, iiuc.
  *     R_Calloc/R_Realloc needs to be R_Free'd, even before error() [R-exts$6.1.2]. An oom within R_Calloc causes a previous R_Calloc to leak so R_Calloc would still needs to be trapped anyway.
  * Therefore, using <<if (!malloc()) STOP(_("helpful context msg"))>> approach to cleanup() on error.
  */
 
 static void free_ustr(void) {
-  for(int i=0; i<ustr_n; i++)
-    SET_TRUELENGTH(ustr[i],0);
+  hash_free(ustr_hash); ustr_hash=NULL;
   free(ustr); ustr=NULL;
   ustr_alloc=0; ustr_n=0; ustr_maxlen=0;
 }
@@ -96,7 +97,6 @@ static void cleanup(void) {
   free_ustr();
   if (key!=NULL) { int i=0; while (key[i]!=NULL) free(key[i++]); }  // ==nradix, other than rare cases e.g. tests 1844.5-6 (#3940), and if a calloc fails
   free(key); key=NULL; nradix=0;
-  savetl_end();  // Restore R's own usage of tl. Must run after the for loop in free_ustr() since only CHARSXP which had tl>0 (R's usage) are stored there.
 }
 
 void internal_error_with_cleanup(const char *call_name, const char *format, ...) {
@@ -233,23 +233,29 @@ int StrCmp(SEXP x, SEXP y)
   return strcmp(CHAR(x), CHAR(y));  // bmerge calls ENC2UTF8 on x and y before passing here
 }
 
-static void cradix_r(SEXP *xsub, int n, int radix)
+static inline uint8_t cradix_byte(SEXP s, int radix)
+{
+  return radix<LENGTH(s) ? (uint8_t)(CHAR(s)[radix]) : 1;  // no NA_STRING present,  1 for "" (could use 0 too maybe since NA_STRING not present)
+}
+
+static void cradix_r(SEXP *xsub, int n, int radix, int *counts, SEXP *xtmp)
 // xsub is a unique set of CHARSXP, to be ordered by reference
 // First time, radix==0, and xsub==x. Then recursively moves SEXP together for cache efficiency.
 // Quite different to iradix because
 //   1) x is known to be unique so fits in cache (wide random access not an issue)
 //   2) they're variable length character strings
 //   3) no need to maintain o.  Just simply reorder x. No grps or push.
+// counts (ustr_maxlen*256, all 0) and xtmp (n) are the calling thread's own, so that buckets can be sorted in parallel
 {
   if (n<=1) return;
-  int *thiscounts = cradix_counts + radix*256;
+  int *thiscounts = counts + radix*256;
   uint8_t lastx = 0;  // the last x is used to test its bin
   for (int i=0; i<n; i++) {
-    lastx = radix<LENGTH(xsub[i]) ? (uint8_t)(CHAR(xsub[i])[radix]) : 1;  // no NA_STRING present,  1 for "" (could use 0 too maybe since NA_STRING not present)
+    lastx = cradix_byte(xsub[i], radix);
     thiscounts[ lastx ]++;
   }
   if (thiscounts[lastx]==n && radix<ustr_maxlen-1) {
-    cradix_r(xsub, n, radix+1);
+    cradix_r(xsub, n, radix+1, counts, xtmp);
     thiscounts[lastx] = 0;  // all x same value, the rest must be 0 already, save the memset
     return;
   }
@@ -258,77 +264,89 @@ static void cradix_r(SEXP *xsub, int n, int radix)
     if (thiscounts[i]) thiscounts[i] = (itmp += thiscounts[i]);  // don't cummulate through 0s, important below
   }
   for (int i=n-1; i>=0; i--) {
-    uint8_t thisx = radix<LENGTH(xsub[i]) ? (uint8_t)(CHAR(xsub[i])[radix]) : 1;
-    cradix_xtmp[--thiscounts[thisx]] = xsub[i];
+    xtmp[--thiscounts[cradix_byte(xsub[i], radix)]] = xsub[i];
   }
-  memcpy(xsub, cradix_xtmp, n*sizeof(SEXP));
+  memcpy(xsub, xtmp, n*sizeof(SEXP));
   if (radix == ustr_maxlen-1) {
     memset(thiscounts, 0, 256*sizeof(int));
     return;
   }
-  if (thiscounts[0] != 0) STOP(_("Logical error. counts[0]=%d in cradix but should have been decremented to 0. radix=%d"), thiscounts[0], radix);
+  // thiscounts[0] is now 0 since no byte is 0 (1 is used for "")
   itmp = 0;
   for (int i=1; i<256; i++) {
     if (thiscounts[i] == 0) continue;
     int thisgrpn = thiscounts[i] - itmp;  // undo cumulate; i.e. diff
-    cradix_r(xsub+itmp, thisgrpn, radix+1);
+    cradix_r(xsub+itmp, thisgrpn, radix+1, counts, xtmp);
     itmp = thiscounts[i];
     thiscounts[i] = 0;  // set to 0 now since we're here, saves memset afterwards. Important to do this ready for this memory's reuse
   }
-  if (itmp<n-1) cradix_r(xsub+itmp, n-itmp, radix+1);  // final group
+  if (itmp<n-1) cradix_r(xsub+itmp, n-itmp, radix+1, counts, xtmp);  // final group
 }
 
 static void cradix(SEXP *x, int n)
+// MSD radix sort of unique strings. The common prefix and the first byte that differs are done here; the up to 255
+// buckets of that byte are then independent so are sorted in parallel, each thread with its own counts and each
+// bucket using its own part of xtmp.
 {
-  cradix_counts = (int *)calloc(ustr_maxlen*256, sizeof(int));  // counts for the letters of left-aligned strings
-  cradix_xtmp = (SEXP *)malloc(ustr_n*sizeof(SEXP));
-  if (!cradix_counts || !cradix_xtmp) {
-    free(cradix_counts); free(cradix_xtmp); // # nocov
-    STOP(_("Failed to alloc cradix_counts and/or cradix_tmp")); // # nocov
+  if (n<=1) return;
+  cradix_xtmp = (SEXP *)malloc(n*sizeof(SEXP));
+  if (!cradix_xtmp) STOP(_("Failed to alloc cradix_counts and/or cradix_tmp")); // # nocov
+  int radix = 0, counts[257];
+  for (;;) {
+    memset(counts, 0, sizeof(counts));
+    for (int i=0; i<n; i++) counts[ cradix_byte(x[i], radix) + 1 ]++;
+    int nbucket = 0;
+    for (int b=1; b<=256; b++) nbucket += counts[b]>0;
+    if (nbucket>1 || radix==ustr_maxlen-1) break;
+    radix++;  // common prefix
+  }
+  for (int b=1; b<=256; b++) counts[b] += counts[b-1];  // counts[b] is now the start of bucket b
+  int next[256];
+  memcpy(next, counts, 256*sizeof(int));
+  for (int i=0; i<n; i++) cradix_xtmp[ next[cradix_byte(x[i], radix)]++ ] = x[i];  // stable, not that it matters since unique
+  memcpy(x, cradix_xtmp, n*sizeof(SEXP));
+  if (radix == ustr_maxlen-1) { free(cradix_xtmp); cradix_xtmp=NULL; return; }
+  int nth = getDTthreads(n, true);
+  size_t ncounts = (size_t)ustr_maxlen*256;  // counts for the letters of left-aligned strings, for each thread
+  cradix_counts = (int *)calloc(nth*ncounts, sizeof(int));
+  if (!cradix_counts && nth>1) cradix_counts = (int *)calloc(ncounts, sizeof(int)), nth=1;  // # nocov
+  if (!cradix_counts) STOP(_("Failed to alloc cradix_counts and/or cradix_tmp")); // # nocov
+  #pragma omp parallel for num_threads(nth) schedule(dynamic)
+  for (int b=1; b<256; b++) {  // byte 0 doesn't occur
+    cradix_r(x+counts[b], counts[b+1]-counts[b], radix+1, cradix_counts + omp_get_thread_num()*ncounts, cradix_xtmp+counts[b]);
   }
-  cradix_r(x, n, 0);
   free(cradix_counts); cradix_counts=NULL;
   free(cradix_xtmp);   cradix_xtmp=NULL;
 }
 
 static void range_str(const SEXP *x, int n, uint64_t *out_min, uint64_t *out_max, int *out_na_count, bool *out_anynotascii, bool *out_anynotutf8)
-// group numbers are left in truelength to be fetched by WRITE_KEY
+// group numbers are left in ustr_hash to be fetched by WRITE_KEY
 {
   int na_count=0;
   bool anynotascii=false, anynotutf8=false;
   if (ustr_n!=0) internal_error_with_cleanup(__func__, "ustr isn't empty when starting range_str: ustr_n=%d, ustr_alloc=%d", ustr_n, ustr_alloc);  // # nocov
   if (ustr_maxlen!=0) internal_error_with_cleanup(__func__, "ustr_maxlen isn't 0 when starting range_str");  // # nocov
-  // savetl_init() has already been called at the start of forder
-  #pragma omp parallel for num_threads(getDTthreads(n, true))
-  for(int i=0; i<n; i++) {
-    SEXP s = x[i];
-    if (s==NA_STRING) {
-      #pragma omp atomic update
-      na_count++;
-      continue;
-    }
-    if (TRUELENGTH(s)<0) continue;  // seen this group before
-    #pragma omp critical
-    if (TRUELENGTH(s)>=0) {  // another thread may have set it while I was waiting, so check it again
-      if (TRUELENGTH(s)>0)   // save any of R's own usage of tl (assumed positive, so we can both count and save in one scan), to restore
-        savetl(s);           // afterwards. From R 2.14.0, tl is initialized to 0, prior to that it was random so this step saved too much.
-      // now save unique SEXP in ustr so i) we can loop through them afterwards and reset TRUELENGTH to 0 and ii) sort uniques when sorting too
-      if (ustr_alloc<=ustr_n) {
-        ustr_alloc = (ustr_alloc==0) ? 16384 : ustr_alloc*2;  // small initial guess, negligible time to alloc 128KB (32 pages)
-        if (ustr_alloc>n) ustr_alloc = n;  // clamp at n. Reaches n when fully unique (no dups)
-        ustr = realloc(ustr, ustr_alloc * sizeof(SEXP));
-        if (ustr==NULL) STOP(_("Unable to realloc %d * %d bytes in range_str"), ustr_alloc, (int)sizeof(SEXP));  // # nocov
-      }
-      ustr[ustr_n++] = s;
-      SET_TRUELENGTH(s, -ustr_n);  // unique in any order is fine. first-appearance order is achieved later in count_group
-      if (LENGTH(s)>ustr_maxlen) ustr_maxlen=LENGTH(s);
-      if (!anynotutf8 &&    // even if anynotascii we still want to know if anynotutf8, and anynotutf8 implies anynotascii already
-            !IS_ASCII(s)) { // anynotutf8 implies anynotascii and IS_ASCII will be cheaper than IS_UTF8, so start with this one
-        if (!anynotascii)
-          anynotascii=true;
-        if (!IS_UTF8(s))
-          anynotutf8=true;
-      }
+  // The unique strings used to be found by marking each CHARSXP's TRUELENGTH as it was first seen, inside a critical
+  // section. A private hash table is built in parallel instead and doesn't touch R's global CHARSXP cache.
+  ustr_hash = hash_build(x, n);
+  if (!ustr_hash) STOP(_("Unable to allocate hash table of unique strings in range_str"));  // # nocov
+  #pragma omp parallel for num_threads(getDTthreads(n, true)) reduction(+:na_count)
+  for(int i=0; i<n; i++) na_count += x[i]==NA_STRING;
+  ustr_alloc = hash_keys(ustr_hash, NULL);
+  ustr = malloc(ustr_alloc * sizeof(SEXP));
+  if (ustr==NULL) STOP(_("Unable to allocate %d * %d bytes in range_str"), ustr_alloc, (int)sizeof(SEXP));  // # nocov
+  hash_keys(ustr_hash, ustr);  // unique in any order is fine. first-appearance order is achieved later in count_group
+  for (int i=0; i<ustr_alloc; i++) {
+    SEXP s = ustr[i];
+    if (s==NA_STRING) continue;
+    ustr[ustr_n++] = s;
+    if (LENGTH(s)>ustr_maxlen) ustr_maxlen=LENGTH(s);
+    if (!anynotutf8 &&    // even if anynotascii we still want to know if anynotutf8, and anynotutf8 implies anynotascii already
+          !IS_ASCII(s)) { // anynotutf8 implies anynotascii and IS_ASCII will be cheaper than IS_UTF8, so start with this one
+      if (!anynotascii)
+        anynotascii=true;
+      if (!IS_UTF8(s))
+        anynotutf8=true;
     }
   }
   *out_na_count = na_count;
@@ -351,38 +369,35 @@ static void range_str(const SEXP *x, int n, uint64_t *out_min, uint64_t *out_max
     for (int i=0; i<ustr_n; i++) {
       SEXP s = ustr3[i];
       if (LENGTH(s)>ustr_maxlen) ustr_maxlen=LENGTH(s);
-      if (TRUELENGTH(s)>0) savetl(s);
     }
     cradix(ustr3, ustr_n);  // sort to detect possible duplicates after converting; e.g. two different non-utf8 map to the same utf8
-    SET_TRUELENGTH(ustr3[0], -1);
-    int o = -1;
-    for (int i=1; i<ustr_n; i++) {
+    hashtab_t *utf8_hash = hash_create(ustr_n);
+    bool ok = utf8_hash && hash_set(utf8_hash, ustr3[0], 1);
+    int o = 1;
+    for (int i=1; ok && i<ustr_n; i++) {
       if (ustr3[i] == ustr3[i-1]) continue;  // use the same o for duplicates
-      SET_TRUELENGTH(ustr3[i], --o);
+      ok = hash_set(utf8_hash, ustr3[i], ++o);
     }
-    // now use the 1-1 mapping from ustr to ustr2 to get the ordering back into original ustr, being careful to reset tl to 0
-    int *tl = (int *)malloc(ustr_n * sizeof(int));
-    if (!tl)
-      STOP(_("Failed to alloc tl when converting strings to UTF8"));  // # nocov
+    // now use the 1-1 mapping from ustr to ustr2 to get the ordering back into original ustr
     const SEXP *tt = STRING_PTR_RO(ustr2);
-    for (int i=0; i<ustr_n; i++) tl[i] = TRUELENGTH(tt[i]);   // fetches the o in ustr3 into tl which is ordered by ustr
-    for (int i=0; i<ustr_n; i++) SET_TRUELENGTH(ustr3[i], 0);    // reset to 0 tl of the UTF8 (and possibly non-UTF in ustr too)
-    for (int i=0; i<ustr_n; i++) SET_TRUELENGTH(ustr[i], tl[i]); // put back the o into ustr's tl
-    free(tl);
+    for (int i=0; ok && i<ustr_n; i++) ok = hash_set(ustr_hash, ustr[i], hash_lookup(utf8_hash, tt[i], 0));
+    hash_free(utf8_hash);
     free(ustr3);
+    if (!ok) STOP(_("Failed to allocate hash table when converting strings to UTF8"));  // # nocov
     UNPROTECT(1);
     *out_min = 1;
-    *out_max = -o;  // could be less than ustr_n if there are duplicates in the utf8s
+    *out_max = o;  // could be less than ustr_n if there are duplicates in the utf8s
   } else {
     *out_min = 1;
     *out_max = ustr_n;
     if (sortType) {
       // that this is always ascending; descending is done in WRITE_KEY using max-this
       cradix(ustr, ustr_n);  // sorts ustr in-place by reference. assumes NA_STRING not present.
-      for(int i=0; i<ustr_n; i++)     // save ordering in the CHARSXP. negative so as to distinguish with R's own usage.
-        SET_TRUELENGTH(ustr[i], -i-1);
     }
-    // else group appearance order was already saved to tl in the first pass
+    // the group number of each string is its position in ustr: sorted, or in whatever order the hash table gave
+    bool ok = true;
+    for (int i=0; ok && i<ustr_n; i++) ok = hash_set(ustr_hash, ustr[i], i+1);
+    if (!ok) STOP(_("Failed to allocate hash table in range_str"));  // # nocov
   }
 }
 
@@ -433,6 +448,107 @@ uint64_t dtwiddle(double x) //const void *p, int i)
 
 void radix_r(const int from, const int to, const int radix);
 
+/*
+  Sorted runs. When a table already keyed has had rows appended, or two keyed tables have been rbind-ed, the rows are a
+  few sorted runs. Those are found with one parallel pass comparing each row's key bytes with the previous row's, and
+  merged pairwise; each merge is split across threads at output positions found by binary search (merge path), so it
+  is stable and parallel even when there are just two runs. When there are more than FORDER_MAXRUNS runs, radix_r()
+  is used as before.
+*/
+#define FORDER_MAXRUNS 32
+
+static inline int keycmp(const int a, const int b)
+{
+  for (int r=0; r<nradix; r++) {
+    if (key[r][a]!=key[r][b]) return key[r][a]<key[r][b] ? -1 : 1;
+  }
+  return 0;
+}
+
+// how many of the first k rows of the stable merge of runs A (m rows) and B (n rows) come from A; ties are taken from A first
+static int corank(const int k, const int *A, const int m, const int *B, const int n)
+{
+  int lo = MAX(0, k-n), hi = MIN(k, m);
+  for (;;) {
+    const int i = lo + (hi-lo)/2, j = k-i;
+    if (i>0 && j<n && keycmp(A[i-1], B[j])>0) hi = i-1;        // too many from A
+    else if (j>0 && i<m && keycmp(B[j-1], A[i])>=0) lo = i+1;  // too few from A
+    else return i;
+  }
+}
+
+static void merge_pair(const int *A, const int m, const int *B, const int n, int *out)
+{
+  const int nchunk = MIN(nth, 1+(m+n)/4096);
+  #pragma omp parallel for num_threads(nchunk)
+  for (int t=0; t<nchunk; t++) {
+    const int k0 = (int)((int64_t)(m+n)*t/nchunk), k1 = (int)((int64_t)(m+n)*(t+1)/nchunk);
+    int i = corank(k0, A, m, B, n), j = k0-i;
+    const int i1 = corank(k1, A, m, B, n), j1 = k1-i1;
+    for (int k=k0; k<k1; k++) out[k] = (j>=j1 || (i<i1 && keycmp(A[i], B[j])<=0)) ? A[i++] : B[j++];
+  }
+}
+
+static int merge_runs(void)
+// returns the number of runs merged, or 0 leaving anso untouched when there are too many
+{
+  const int nbatch = nth, batchSize = (nrow-1)/nbatch + 1;
+  int *descents = (int *)malloc((size_t)nbatch*(FORDER_MAXRUNS+1)*sizeof(int)), *ndescents = descents + nbatch*FORDER_MAXRUNS;
+  if (!descents) return 0; // # nocov
+  bool toomany = false;
+  #pragma omp parallel for num_threads(nth)
+  for (int b=0; b<nbatch; b++) {
+    int *my_descents = descents + b*FORDER_MAXRUNS, n=0;
+    const int to = MIN(nrow, (b+1)*batchSize);
+    for (int i=MAX(1, b*batchSize); i<to && !toomany; i++) {
+      if (keycmp(i-1, i)<=0) continue;
+      if (n==FORDER_MAXRUNS) { toomany=true; break; }
+      my_descents[n++] = i;
+    }
+    ndescents[b] = n;
+  }
+  int runstart[FORDER_MAXRUNS+1], nrun = 1;
+  runstart[0] = 0;
+  for (int b=0; b<nbatch && !toomany; b++) for (int d=0; d<ndescents[b]; d++) {
+    if (nrun==FORDER_MAXRUNS) { toomany=true; break; }
+    runstart[nrun++] = descents[b*FORDER_MAXRUNS+d];
+  }
+  free(descents);
+  if (toomany) return 0;
+  runstart[nrun] = nrow;
+  const int nrun0 = nrun;
+  int *src = (int *)malloc(nrow*sizeof(int)), *dst = anso;  // 0-based row numbers while merging
+  if (!src) return 0; // # nocov
+  int *buf = src;
+  #pragma omp parallel for num_threads(nth)
+  for (int i=0; i<nrow; i++) src[i] = i;
+  while (nrun>1) {
+    int r=0, newn=0;
+    for (; r+1<nrun; r+=2) {
+      const int from = runstart[r], mid = runstart[r+1], to = runstart[r+2];
+      merge_pair(src+from, mid-from, src+mid, to-mid, dst+from);
+      runstart[newn++] = from;
+    }
+    if (r<nrun) {  // odd one out
+      memcpy(dst+runstart[r], src+runstart[r], (runstart[r+1]-runstart[r])*sizeof(int));
+      runstart[newn++] = runstart[r];
+    }
+    runstart[newn] = nrow;
+    nrun = newn;
+    int *tmp=src; src=dst; dst=tmp;
+  }
+  if (retgrp) {
+    int *sizes = dst, ngrp = 0, last = 0;  // dst is free now
+    for (int i=1; i<nrow; i++) if (keycmp(src[i-1], src[i])) { sizes[ngrp++] = i-last; last = i; }
+    sizes[ngrp++] = nrow-last;
+    push(sizes, ngrp);
+  }
+  #pragma omp parallel for num_threads(nth)
+  for (int i=0; i<nrow; i++) anso[i] = src[i]+1;  // src is anso when there were an odd number of merge rounds; in place is fine
+  free(buf);
+  return nrun0;
+}
+
 /*
   OpenMP is used here to parallelize multiple operations that come together to
     sort a data.table using the Radix algorithm. These include:
@@ -546,7 +662,6 @@ SEXP forder(SEXP DT, SEXP by, SEXP retGrpArg, SEXP retStatsArg, SEXP sortGroupsA
   #pragma omp parallel for num_threads(getDTthreads(nrow, true))
   for (int i=0; i<nrow; i++) anso[i]=i+1;   // gdb 8.1.0.20180409-git very slow here, oddly
   TEND(1)
-  savetl_init();   // from now on use Error not error
 
   int ncol=length(by);
   int keyAlloc = (ncol+n_cplx)*8 + 1;         // +1 for NULL to mark end; calloc to initialize with NULLs
@@ -766,7 +881,7 @@ SEXP forder(SEXP DT, SEXP by, SEXP retGrpArg, SEXP retStatsArg, SEXP sortGroupsA
           if (nalast==-1) anso[i]=0;
           elem = naval;
         } else {
-          elem = -TRUELENGTH(xd[i]);
+          elem = hash_lookup(ustr_hash, xd[i], 0);
         }
         WRITE_KEY
       }}
@@ -802,7 +917,12 @@ SEXP forder(SEXP DT, SEXP by, SEXP retGrpArg, SEXP retStatsArg, SEXP sortGroupsA
     }
   }
   if (nradix) {
-    radix_r(0, nrow-1, 0);  // top level recursive call: (from, to, radix)
+    // nalast==-1 leaves 0 in anso for the NA rows to be removed, which merge_runs() doesn't do
+    int nrun = 0;
+    if (!sortType || nalast==-1 || !(nrun=merge_runs()))
+      radix_r(0, nrow-1, 0);  // top level recursive call: (from, to, radix)
+    else if (verbose)
+      Rprintf(_("forder merged %d sorted runs\n"), nrun);
   } else {
     push(&nrow, 1);
   }
@@ -1641,6 +1761,170 @@ bool idxAnyNF(SEXP idx) {
   return INTEGER(getAttrib(idx, sym_anyna))[0]>0 || INTEGER(getAttrib(idx, sym_anyinfnan))[0]>0;
 }
 
+// how many leading columns of by= the index named "__col1__col2..." is on, and in all whether the index is on just those
+static int idxPrefixLen(SEXP names, const char *idxname, const int *byd, const int nby, bool *all)
+{
+  int k = 0;
+  const char *p = idxname;
+  while (k<nby && p[0]=='_' && p[1]=='_') {
+    p += 2;
+    const char *e = strstr(p, "__");
+    const size_t len = e ? (size_t)(e-p) : strlen(p);
+    const char *col = CHAR(STRING_ELT(names, byd[k]-1));
+    if (strlen(col)!=len || strncmp(col, p, len)) { p -= 2; break; }
+    k++;
+    p += len;
+  }
+  *all = *p=='\0';
+  return k;
+}
+
+// anyna, anyinfnan, anynotascii and anynotutf8 of the first k by= columns, as forder would find them
+static void prefixStats(SEXP DT, const int *byd, const int k, int *stats)
+{
+  for (int j=0; j<k; ++j) {
+    SEXP x = VECTOR_ELT(DT, byd[j]-1);
+    const int n = length(x);
+    switch(TYPEOF(x)) {
+    case LGLSXP: case INTSXP: {
+      const int *xd = INTEGER_RO(x);
+      for (int i=0; i<n && !stats[0]; ++i) stats[0] |= xd[i]==NA_INTEGER;
+    } break;
+    case REALSXP: {
+      if (INHERITS(x, char_integer64)) {
+        const int64_t *xd = (const int64_t *)REAL_RO(x);
+        for (int i=0; i<n && !stats[0]; ++i) stats[0] |= xd[i]==NA_INTEGER64;
+      } else {
+        const double *xd = REAL_RO(x);
+        for (int i=0; i<n; ++i) if (!R_FINITE(xd[i])) stats[ISNA(xd[i]) ? 0 : 1] = 1;
+      }
+    } break;
+    case STRSXP: {
+      const SEXP *xd = STRING_PTR_RO(x);
+      for (int i=0; i<n; ++i) {
+        if (xd[i]==NA_STRING) stats[0] = 1;
+        else if (!IS_ASCII(xd[i])) { stats[2] = 1; if (!IS_UTF8(xd[i])) stats[3] = 1; }
+      }
+    } break;
+    default:
+      internal_error_with_cleanup(__func__, "unsupported type '%s'", type2char(TYPEOF(x))); // # nocov
+    }
+  }
+}
+
+// When the key or an index is on a leading part of by=, e.g. an index on (a,b,c) and by=(a,b), or the key is (a) and
+// by=(a,b), that ordering gives the groups of its leading columns already. Each row is numbered by its group and the
+// group numbers sorted together with just the remaining by= columns; the leading columns aren't looked at again apart
+// from finding where their groups start. Rows stay in their original order within ties, as forder leaves them.
+// Returns R_NilValue if no key or index has a leading column in common with by=.
+static SEXP forderPrefix(SEXP DT, SEXP by, SEXP retGrpArg, SEXP retStatsArg, SEXP sortGroupsArg, SEXP naArg, const bool useIndex, const bool verbose)
+{
+  const int nby = length(by), *byd = INTEGER(by), nrow = length(VECTOR_ELT(DT, 0));
+  if (nrow==0) return R_NilValue;
+  SEXP names = getAttrib(DT, R_NamesSymbol);
+  int best = 0, bestScore = 0;  // a longer prefix is better, then one that has its group starts already
+  bool bestAll = false;
+  SEXP o = R_NilValue;          // the ordering by the prefix, R_NilValue or integer() if the rows are in that order
+  const char *from = NULL;
+  SEXP key = getAttrib(DT, sym_sorted);
+  if (isString(key)) {
+    int k = 0;
+    while (k<nby && k<LENGTH(key) && STRING_ELT(key, k)==STRING_ELT(names, byd[k]-1)) k++;
+    if (k) { best = k; bestScore = 2*k; bestAll = k==LENGTH(key); from = "key"; }
+  }
+  SEXP index = useIndex ? getAttrib(DT, sym_index) : R_NilValue;
+  for (SEXP s=isNull(index) ? R_NilValue : ATTRIB(index); s!=R_NilValue; s=CDR(s)) {
+    SEXP idx = CAR(s);
+    if (!isInteger(idx) || (length(idx)!=0 && length(idx)!=nrow)) continue;
+    bool all;
+    const int k = idxPrefixLen(names, CHAR(PRINTNAME(TAG(s))), byd, nby, &all);
+    const int score = 2*k + (all && !isNull(getAttrib(idx, sym_starts)));
+    if (k && score>bestScore) { best = k; bestScore = score; bestAll = all; o = idx; from = CHAR(PRINTNAME(TAG(s))); }
+  }
+  if (!best) return R_NilValue;
+  for (int j=0; j<best; ++j) {
+    switch(TYPEOF(VECTOR_ELT(DT, byd[j]-1))) {
+    case LGLSXP: case INTSXP: case REALSXP: case STRSXP: break;
+    default: return R_NilValue;
+    }
+  }
+  int nprotect = 0;
+  SEXP gid = PROTECT(allocVector(INTSXP, nrow)); nprotect++;
+  int *gidd = INTEGER(gid), ngrp = 0;
+  const int *od = length(o) ? INTEGER(o) : NULL;
+  if (bestAll && !isNull(o) && !isNull(getAttrib(o, sym_starts))) {
+    SEXP starts = getAttrib(o, sym_starts);
+    const int *startsd = INTEGER(starts);
+    ngrp = length(starts);
+    for (int g=0; g<ngrp; ++g) {
+      const int end = g+1<ngrp ? startsd[g+1]-1 : nrow;
+      for (int i=startsd[g]-1; i<end; ++i) gidd[od ? od[i]-1 : i] = g+1;
+    }
+  } else {
+    // a new group wherever the prefix changes, with values equal as forder compares them; e.g. -0.0==0.0. Strings are
+    // translated to UTF-8 up front, as guniqueN does, so that equal strings are the same CHARSXP
+    SEXP cols = PROTECT(allocVector(VECSXP, best)); nprotect++;
+    for (int j=0; j<best; ++j) {
+      SEXP x = VECTOR_ELT(DT, byd[j]-1);
+      if (TYPEOF(x)==STRSXP) {
+        const SEXP *xd = STRING_PTR_RO(x);
+        int i=0;
+        while (i<nrow && !NEED2UTF8(xd[i])) i++;
+        if (i<nrow) {
+          x = allocVector(STRSXP, nrow);
+          SET_VECTOR_ELT(cols, j, x);  // protected before ENC2UTF8 allocates
+          for (int k=0; k<nrow; ++k) SET_STRING_ELT(x, k, ENC2UTF8(xd[k]));
+          continue;
+        }
+      }
+      SET_VECTOR_ELT(cols, j, x);
+    }
+    for (int i=0, prev=-1; i<nrow; ++i) {
+      const int r = od ? od[i]-1 : i;
+      bool same = prev>=0;
+      for (int j=0; same && j<best; ++j) {
+        SEXP x = VECTOR_ELT(cols, j);
+        switch(TYPEOF(x)) {
+        case LGLSXP: case INTSXP: same = INTEGER(x)[r]==INTEGER(x)[prev]; break;
+        case REALSXP: same = INHERITS(x, char_integer64) ? ((const int64_t *)REAL(x))[r]==((const int64_t *)REAL(x))[prev]
+                                                          : dtwiddle(REAL(x)[r])==dtwiddle(REAL(x)[prev]); break;
+        default: same = STRING_ELT(x, r)==STRING_ELT(x, prev);
+        }
+      }
+      if (!same) ngrp++;
+      gidd[r] = ngrp;
+      prev = r;
+    }
+  }
+  const int nsub = 1+nby-best;
+  SEXP sub = PROTECT(allocVector(VECSXP, nsub)); nprotect++;
+  SEXP subby = PROTECT(allocVector(INTSXP, nsub)); nprotect++;
+  SEXP subasc = PROTECT(allocVector(INTSXP, nsub)); nprotect++;
+  SET_VECTOR_ELT(sub, 0, gid);
+  for (int j=0; j<nsub; ++j) {
+    if (j) SET_VECTOR_ELT(sub, j, VECTOR_ELT(DT, byd[best+j-1]-1));
+    INTEGER(subby)[j] = j+1;
+    INTEGER(subasc)[j] = 1;
+  }
+  if (verbose)
+    Rprintf("forderReuseSorting: sorting within the %d groups of the first %d column(s) of %s%s\n", ngrp, best, isNull(o) ? "" : "index ", isNull(o) ? from : from+2);
+  SEXP ans = PROTECT(forder(sub, subby, retGrpArg, retStatsArg, sortGroupsArg, subasc, naArg)); nprotect++;
+  if (LOGICAL(retStatsArg)[0]) {
+    // the group numbers have no NA; the prefix columns' own statistics are kept with an index on just those columns
+    int stats[4] = {0, 0, 0, 0};
+    const SEXP syms[4] = {sym_anyna, sym_anyinfnan, sym_anynotascii, sym_anynotutf8};
+    if (bestAll && !isNull(o) && !isNull(getAttrib(o, sym_anyna)) && !isNull(getAttrib(o, sym_anynotutf8))) {
+      for (int i=0; i<4; ++i) stats[i] = INTEGER(getAttrib(o, syms[i]))[0]>0;
+    } else {
+      prefixStats(DT, byd, best, stats);
+    }
+    for (int i=0; i<4; ++i)
+      if (stats[i]) setAttrib(ans, syms[i], ScalarInteger(1));
+  }
+  UNPROTECT(nprotect);
+  return ans;
+}
+
 // forder, re-use existing key or index if possible, otherwise call forder
 SEXP forderReuseSorting(SEXP DT, SEXP by, SEXP retGrpArg, SEXP retStatsArg, SEXP sortGroupsArg, SEXP ascArg, SEXP naArg, SEXP reuseSortingArg) {
   const bool verbose = GetVerbose();
@@ -1671,7 +1955,7 @@ SEXP forderReuseSorting(SEXP DT, SEXP by, SEXP retGrpArg, SEXP retStatsArg, SEXP
   int reuseSorting = LOGICAL(reuseSortingArg)[0];
   if (!length(DT))
     return allocVector(INTSXP, 0);
-  int opt = -1; // -1=unknown, 0=none, 1=keyOpt, 2=idxOpt
+  int opt = -1; // -1=unknown, 0=none, 1=keyOpt, 2=idxOpt, 3=prefixOpt
   if (reuseSorting==NA_LOGICAL) {
     if (INHERITS(DT, char_datatable) && // unnamed list should not be optimized
         sortGroups &&
@@ -1761,16 +2045,23 @@ SEXP forderReuseSorting(SEXP DT, SEXP by, SEXP retGrpArg, SEXP retStatsArg, SEXP
       }
     }
   }
+  if (opt == -1 && !na) {  // the key and indices have NA first
+    ans = forderPrefix(DT, by, retGrpArg, retStatsArg, sortGroupsArg, naArg, GetUseIndex(), verbose);
+    if (!isNull(ans)) {
+      opt = 3; // prefixOpt
+      PROTECT(ans); protecti++;
+    }
+  }
   if (opt < 1) {
     ans = PROTECT(forder(DT, by, retGrpArg, retStatsArg, sortGroupsArg, ascArg, naArg)); protecti++;
-    if (opt == -1 && // opt==0 means that arguments (sort, asc) were not of type index, or reuseSorting=FALSE
-        (!na || (retStats && !idxAnyNF(ans))) && // lets create index even if na.last=T used but no NAs detected!
-        GetUseIndex() &&
-        GetAutoIndex()) { // disabled by default, use datatable.forder.auto.index=T to enable, do not export/document, use for debugging only
-      putIndex(DT, by, ans);
-      if (verbose)
-        Rprintf("forderReuseSorting: setting index (retGrp=%d, retStats=%d) on DT: %s\n", retGrp, retStats, CHAR(STRING_ELT(idxName(DT, by), 0)));
-    }
+  }
+  if ((opt == -1 || opt == 3) && // opt==0 means that arguments (sort, asc) were not of type index, or reuseSorting=FALSE
+      (!na || (retStats && !idxAnyNF(ans))) && // lets create index even if na.last=T used but no NAs detected!
+      GetUseIndex() &&
+      GetAutoIndex()) { // disabled by default, use datatable.forder.auto.index=T to enable, do not export/document, use for debugging only
+    putIndex(DT, by, ans);
+    if (verbose)
+      Rprintf("forderReuseSorting: setting index (retGrp=%d, retStats=%d) on DT: %s\n", retGrp, retStats, CHAR(STRING_ELT(idxName(DT, by), 0)));
   }
   if (verbose)
     Rprintf("forderReuseSorting: opt=%d, took %.3fs\n", opt, omp_get_wtime()-tic);
@@ -16,6 +16,8 @@
  *   adding/removing in/out of sliding window of observations
  * algo = 1: frollmeanExact
  *   recalculate whole mean for each observation, roundoff correction is adjusted, also support for NaN and Inf
+ * algo = 2: frolldet
+ *   options(datatable.deterministic=TRUE), see frolldet below
  */
 void frollmean(unsigned int algo, double *x, uint64_t nx, ans_t *ans, int k, int align, double fill, bool narm, int hasna, bool verbose) {
   if (nx < k) {                                                 // if window width bigger than input just return vector of fill values
@@ -34,6 +36,8 @@ void frollmean(unsigned int algo, double *x, uint64_t nx, ans_t *ans, int k, int
     frollmeanFast(x, nx, ans, k, fill, narm, hasna, verbose);
   } else if (algo==1) {
     frollmeanExact(x, nx, ans, k, fill, narm, hasna, verbose);
+  } else if (algo==2) {
+    frolldet(true, x, nx, ans, k, NULL, fill, narm);
   }
   if (ans->status < 3 && align < 1) {                           // align center or left, only when no errors occurred
     int k_ = align==-1 ? k-1 : floor(k/2);                      // offset to shift
@@ -242,6 +246,8 @@ void frollsum(unsigned int algo, double *x, uint64_t nx, ans_t *ans, int k, int
     frollsumFast(x, nx, ans, k, fill, narm, hasna, verbose);
   } else if (algo==1) {
     frollsumExact(x, nx, ans, k, fill, narm, hasna, verbose);
+  } else if (algo==2) {
+    frolldet(false, x, nx, ans, k, NULL, fill, narm);
   }
   if (ans->status < 3 && align < 1) {
     int k_ = align==-1 ? k-1 : floor(k/2);
@@ -406,6 +412,46 @@ void frollsumExact(double *x, uint64_t nx, ans_t *ans, int k, double fill, bool
   }
 }
 
+/* rolling mean or sum for options(datatable.deterministic=TRUE)
+ * as frollmeanFast and frollsumFast a single pass sliding window, but in double with Kahan-Neumaier compensation instead
+ * of long double, whose precision differs by platform, so results are the same on all platforms. NA/NaN, Inf and -Inf
+ * are counted rather than added so that they leave the window again. For adaptive windows (k not NULL) each window is
+ * summed afresh, in parallel, as in the exact algorithms.
+ */
+typedef struct { double s, c; int nna, npinf, nninf; } rollacc_t;
+static inline void racc_add(rollacc_t *a, const double v, const int sign) {
+  if (ISNAN(v)) a->nna += sign;
+  else if (v==R_PosInf) a->npinf += sign;
+  else if (v==R_NegInf) a->nninf += sign;
+  else { const double w = sign>0 ? v : -v; DSUM_ADD(a->s, a->c, w); }
+}
+static inline double racc_value(const rollacc_t *a, const int n, const bool mean, const bool narm) {
+  if (a->nna && !narm) return NA_REAL;
+  if (a->npinf && a->nninf) return R_NaN;
+  if (a->npinf || a->nninf) return a->npinf ? R_PosInf : R_NegInf;
+  const int m = n - a->nna;
+  if (!mean) return a->s + a->c;
+  return m ? (a->s + a->c)/m : R_NaN;
+}
+void frolldet(bool mean, double *x, uint64_t nx, ans_t *ans, int kk, const int *k, double fill, bool narm) {
+  if (!k) {
+    rollacc_t a = {0};
+    for (uint64_t i=0; i<nx; i++) {
+      racc_add(&a, x[i], 1);
+      if (i>=kk) racc_add(&a, x[i-kk], -1);
+      ans->dbl_v[i] = i+1<kk ? fill : racc_value(&a, kk, mean, narm);
+    }
+  } else {
+    #pragma omp parallel for num_threads(getDTthreads(nx, true))
+    for (uint64_t i=0; i<nx; i++) {
+      if (i+1 < k[i]) { ans->dbl_v[i] = fill; continue; }
+      rollacc_t a = {0};
+      for (int j=-k[i]+1; j<=0; j++) racc_add(&a, x[i+j], 1);
+      ans->dbl_v[i] = racc_value(&a, k[i], mean, narm);
+    }
+  }
+}
+
 /* fast rolling any R function
  * not plain C, not thread safe
  * R eval() allocates
@@ -14,6 +14,8 @@ void fadaptiverollmean(unsigned int algo, double *x, uint64_t nx, ans_t *ans, in
     fadaptiverollmeanFast(x, nx, ans, k, fill, narm, hasna, verbose);
   } else if (algo==1) {
     fadaptiverollmeanExact(x, nx, ans, k, fill, narm, hasna, verbose);
+  } else if (algo==2) {
+    frolldet(true, x, nx, ans, 0, k, fill, narm);
   }
   if (verbose)
     snprintf(end(ans->message[0]), 500, _("%s: processing algo %u took %.3fs\n"), __func__, algo, omp_get_wtime()-tic);
@@ -209,6 +211,8 @@ void fadaptiverollsum(unsigned int algo, double *x, uint64_t nx, ans_t *ans, int
     fadaptiverollsumFast(x, nx, ans, k, fill, narm, hasna, verbose);
   } else if (algo==1) {
     fadaptiverollsumExact(x, nx, ans, k, fill, narm, hasna, verbose);
+  } else if (algo==2) {
+    frolldet(false, x, nx, ans, 0, k, fill, narm);
   }
   if (verbose)
     snprintf(end(ans->message[0]), 500, _("%s: processing algo %u took %.3fs\n"), __func__, algo, omp_get_wtime()-tic);
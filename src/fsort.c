@@ -2,10 +2,10 @@
 
 #define INSERT_THRESH 200  // TODO: expose via api and test
 
-static void dinsert(double *x, const int n) {   // TODO: if and when twiddled, double => ull
+static void dinsert(uint64_t *x, const int n) {
   if (n<2) return;
   for (int i=1; i<n; ++i) {
-    double xtmp = x[i];
+    uint64_t xtmp = x[i];
     int j = i-1;
     if (xtmp<x[j]) {
       x[j+1] = x[j];
@@ -19,22 +19,22 @@ static void dinsert(double *x, const int n) {   // TODO: if and when twiddled, d
 static uint64_t minULL;
 
 static void dradix_r(  // single-threaded recursive worker
-  double *in,          // n doubles to be sorted
-  double *working,     // working memory to put the sorted items before copying over *in; must not overlap *in
+  uint64_t *in,        // n keys to be sorted
+  uint64_t *working,   // working memory to put the sorted items before copying over *in; must not overlap *in
   uint64_t n,          // number of items to sort.  *in and *working must be at least n long
-  int fromBit,         // After twiddle to ordered ull, the bits [fromBit,toBit] are used to count
+  int fromBit,         // The bits [fromBit,toBit] are used to count
   int toBit,           //   fromBit<toBit; bit 0 is the least significant; fromBit is right shift amount too
   uint64_t *counts     // already zero'd counts vector, 2^(toBit-fromBit+1) long. A stack of these is reused.
 ) {
   uint64_t width = 1ULL<<(toBit-fromBit+1);
   uint64_t mask = width-1;
 
-  const double *tmp=in;
+  const uint64_t *tmp=in;
   for (uint64_t i=0; i<n; ++i) {
-    counts[(*(uint64_t *)tmp - minULL) >> fromBit & mask]++;
+    counts[(*tmp - minULL) >> fromBit & mask]++;
     tmp++;
   }
-  int last = (*(uint64_t *)--tmp - minULL) >> fromBit & mask;
+  int last = (*--tmp - minULL) >> fromBit & mask;
   if (counts[last] == n) {
     // Single value for these bits here. All counted in one bucket which must be the bucket for the last item.
     counts[last] = 0;  // clear ready for reuse. All other counts must be zero already so save time by not setting to 0.
@@ -54,12 +54,12 @@ static void dradix_r(  // single-threaded recursive worker
 
   tmp=in;
   for (uint64_t i=0; i<n; ++i) {  // go forwards not backwards to give cpu pipeline better chance
-    int thisx = (*(uint64_t *)tmp - minULL) >> fromBit & mask;
+    int thisx = (*tmp - minULL) >> fromBit & mask;
     working[ counts[thisx]++ ] = *tmp;
     tmp++;
   }
 
-  memcpy(in, working, n*sizeof(double));
+  memcpy(in, working, n*sizeof(uint64_t));
 
   if (fromBit==0) {
     // nothing left to do other than reset the counts to 0, ready for next recursion
@@ -111,78 +111,119 @@ static size_t shrinkMSB(size_t MSBsize, uint64_t *msbCounts, int *order, Rboolea
 /*
   OpenMP is used here to find the range and distribution of data for efficient
     grouping and sorting.
+
+  Values are sorted as unsigned 64-bit keys which order the same as the values: the sign bit is flipped, and for
+  doubles the other bits of negatives too. Decreasing order sorts the keys of -x. Key 0 is reserved for NA (and, for
+  doubles, 1 for NaN), which -x and twiddling can't produce from other values, so the NAs are first after sorting; they
+  are then moved to the end or dropped according to na.last. Integers can have key 1 (-2147483647, or INT64_MIN+1 for
+  integer64), so only key 0 counts as NA for them. Keys are untwiddled back to values in a final parallel sweep.
 */
-SEXP fsort(SEXP x, SEXP verboseArg) {
+enum {FS_DOUBLE, FS_INT, FS_INT64};
+#define SIGN64 0x8000000000000000ULL
+
+static inline uint64_t fskey(const void *x, int type, bool desc, R_xlen_t i)
+{
+  switch(type) {
+  case FS_INT: {
+    const int v = ((const int *)x)[i];
+    if (v==NA_INTEGER) return 0;
+    return (uint32_t)(desc ? -v : v) ^ 0x80000000;
+  }
+  case FS_INT64: {
+    const int64_t v = ((const int64_t *)x)[i];
+    if (v==NA_INTEGER64) return 0;
+    return (uint64_t)(desc ? -v : v) ^ SIGN64;
+  }
+  default: {
+    double v = ((const double *)x)[i];
+    if (ISNAN(v)) return R_IsNA(v) ? 0 : 1;
+    if (desc) v = -v;
+    union {double d; uint64_t u64;} u;
+    u.d = v;
+    return (u.u64 & SIGN64) ? ~u.u64 : u.u64 ^ SIGN64;
+  }}
+}
+
+SEXP fsort(SEXP x, SEXP decreasingArg, SEXP naLastArg, SEXP verboseArg) {
   double t[10];
   t[0] = wallclock();
   if (!IS_TRUE_OR_FALSE(verboseArg))
     error(_("%s must be TRUE or FALSE"), "verbose");
   Rboolean verbose = LOGICAL(verboseArg)[0];
-  if (!isNumeric(x)) error(_("x must be a vector of type double currently"));
+  if (!IS_TRUE_OR_FALSE(decreasingArg))
+    error(_("%s must be TRUE or FALSE"), "decreasing");
+  const bool desc = LOGICAL(decreasingArg)[0];
+  if (!isLogical(naLastArg) || LENGTH(naLastArg)!=1)
+    error(_("%s must be TRUE, FALSE or NA"), "na.last");
+  const int nalast = LOGICAL(naLastArg)[0];  // TRUE, FALSE or NA_LOGICAL to remove NAs
+  int type;
+  switch(TYPEOF(x)) {
+  case LGLSXP: case INTSXP: type = FS_INT; break;
+  case REALSXP: type = INHERITS(x, char_integer64) ? FS_INT64 : FS_DOUBLE; break;
+  default: error(_("x must be a vector of type double, integer or logical"));
+  }
+  const R_xlen_t n = xlength(x);
+  const void *xp = DATAPTR_RO(x);
   // TODO: not only detect if already sorted, but if it is, just return x to save the duplicate
 
-  SEXP ansVec = PROTECT(allocVector(REALSXP, xlength(x)));
+  // the keys are sorted in ans when it's 8 bytes wide, otherwise in working memory; allocate early in case fails if not enough RAM
+  SEXP ansVec = PROTECT(allocVector(TYPEOF(x), n));
   int nprotect = 1;
-  double *ans = REAL(ansVec);
-  // allocate early in case fails if not enough RAM
-  // TODO: document this is much cheaper than a copy followed by in-place.
+  uint64_t *ans = type==FS_INT ? (uint64_t *)R_alloc(n, sizeof(uint64_t)) : (uint64_t *)REAL(ansVec);
+  if (n==0) { copyMostAttrib(x, ansVec); UNPROTECT(nprotect); return ansVec; }
 
-  int nth = getDTthreads(xlength(x), true);
+  int nth = getDTthreads(n, true);
   int nBatch=nth*2;  // at least nth; more to reduce last-man-home; but not too large to keep counts small in cache
   if (verbose)
     Rprintf("nth=%d, nBatch=%d\n", nth, nBatch); // # notranslate
 
-  size_t batchSize = (xlength(x)-1)/nBatch + 1;
+  size_t batchSize = (n-1)/nBatch + 1;
   if (batchSize < 1024) batchSize = 1024; // simple attempt to work reasonably for short vector. 1024*8 = 2 4kb pages
-  nBatch = (xlength(x)-1)/batchSize + 1;
-  size_t lastBatchSize = xlength(x) - (nBatch-1)*batchSize;
-  // could be that lastBatchSize == batchSize when i) xlength(x) is multiple of nBatch
+  nBatch = (n-1)/batchSize + 1;
+  size_t lastBatchSize = n - (nBatch-1)*batchSize;
+  // could be that lastBatchSize == batchSize when i) n is multiple of nBatch
   // and ii) for small vectors with just one batch
 
   t[1] = wallclock();
-  double *mins = (double *)malloc(nBatch * sizeof(double));
-  double *maxs = (double *)malloc(nBatch * sizeof(double));
-  if (!mins || !maxs) {
-    free(mins); free(maxs); // # nocov
-    error(_("Failed to allocate %d bytes in fsort()."), (int)(2 * nBatch * sizeof(double))); // # nocov
+  uint64_t *mins = (uint64_t *)malloc(nBatch * sizeof(uint64_t));
+  uint64_t *maxs = (uint64_t *)malloc(nBatch * sizeof(uint64_t));
+  R_xlen_t *nas = (R_xlen_t *)malloc(nBatch * sizeof(R_xlen_t));
+  if (!mins || !maxs || !nas) {
+    free(mins); free(maxs); free(nas); // # nocov
+    error(_("Failed to allocate %d bytes in fsort()."), (int)(3 * nBatch * sizeof(uint64_t))); // # nocov
   }
-  const double *restrict xp = REAL(x);
   #pragma omp parallel for schedule(dynamic) num_threads(getDTthreads(nBatch, false))
   for (int batch=0; batch<nBatch; ++batch) {
     uint64_t thisLen = (batch==nBatch-1) ? lastBatchSize : batchSize;
-    const double *restrict d = xp + batchSize*batch;
-    double myMin=*d, myMax=*d;
-    d++;
-    for (uint64_t j=1; j<thisLen; ++j) {
+    const R_xlen_t from = batchSize*batch;
+    uint64_t myMin=UINT64_MAX, myMax=0;
+    R_xlen_t myNA=0;
+    for (uint64_t j=0; j<thisLen; ++j) {
       // TODO: test for sortedness here as well.
-      if (*d<myMin) myMin=*d;
-      else if (*d>myMax) myMax=*d;
-      d++;
+      const uint64_t k = fskey(xp, type, desc, from+j);
+      myNA += type==FS_DOUBLE ? k<2 : k==0;
+      if (k<myMin) myMin=k;
+      if (k>myMax) myMax=k;
     }
     mins[batch] = myMin;
     maxs[batch] = myMax;
+    nas[batch] = myNA;
   }
   t[2] = wallclock();
-  double min=mins[0], max=maxs[0];
+  uint64_t maxULL=maxs[0];
+  R_xlen_t nna=nas[0];
+  minULL=mins[0];  // set static global for use by dradix_r
   for (int i=1; i<nBatch; ++i) {
     // TODO: if boundaries are sorted then we only need sort the unsorted batches known above
-    if (mins[i]<min) min=mins[i];
-    if (maxs[i]>max) max=maxs[i];
+    if (mins[i]<minULL) minULL=mins[i];
+    if (maxs[i]>maxULL) maxULL=maxs[i];
+    nna += nas[i];
   }
-  free(mins); free(maxs);
-  if (verbose) Rprintf(_("Range = [%g,%g]\n"), min, max);
-  if (min < 0.0) error(_("Cannot yet handle negatives."));
-  // TODO: -0ULL should allow negatives
-  //       avoid twiddle function call as expensive in recent tests (0.34 vs 2.7)
-  //       possibly twiddle once to *ans, then untwiddle at the end in a fast parallel sweep
-
-  union {double d; uint64_t u64;} u;
-  u.d = max;
-  uint64_t maxULL = u.u64;
-  u.d = min;
-  minULL = u.u64;  // set static global for use by dradix_r
-
-  int maxBit = floor(log(maxULL-minULL) / log(2));  // 0 is the least significant bit
+  free(mins); free(maxs); free(nas);
+  if (verbose) Rprintf(_("Range of keys = [%"PRIu64",%"PRIu64"], %"PRId64" NA\n"), minULL, maxULL, (int64_t)nna);
+
+  int maxBit = 0;  // 0 is the least significant bit
+  while (maxBit<63 && (maxULL-minULL)>>(maxBit+1)) maxBit++;
   int MSBNbits = maxBit > 15 ? 16 : maxBit+1;       // how many bits make up the MSB
   int shift = maxBit + 1 - MSBNbits;                // the right shift to leave the MSB bits remaining
   size_t MSBsize = 1LL<<MSBNbits;                   // the number of possible MSB values (16 bits => 65,536)
@@ -201,11 +242,10 @@ SEXP fsort(SEXP x, SEXP verboseArg) {
   #pragma omp parallel for num_threads(nth)
   for (int batch=0; batch<nBatch; ++batch) {
     uint64_t thisLen = (batch==nBatch-1) ? lastBatchSize : batchSize;
-    const uint64_t *restrict tmp = (uint64_t *)(xp + batchSize*batch);
+    const R_xlen_t from = batchSize*batch;
     uint64_t *restrict thisCounts = counts + batch*MSBsize;
     for (uint64_t j=0; j<thisLen; ++j) {
-      thisCounts[(*tmp - minULL) >> shift]++;
-      tmp++;
+      thisCounts[(fskey(xp, type, desc, from+j) - minULL) >> shift]++;
     }
   }
 
@@ -222,19 +262,18 @@ SEXP fsort(SEXP x, SEXP verboseArg) {
   }  // leaves msb cumSum in the last batch i.e. last row of the matrix
 
   t[4] = wallclock();
-  uint64_t *restrict ansi64 = (uint64_t *)ans;
   #pragma omp parallel for num_threads(nth)
   for (int batch=0; batch<nBatch; ++batch) {
     uint64_t thisLen = (batch==nBatch-1) ? lastBatchSize : batchSize;
-    const uint64_t *restrict source = (uint64_t *)(xp + batchSize*batch);
+    const R_xlen_t from = batchSize*batch;
     uint64_t *restrict thisCounts = counts + batch*MSBsize;
     for (uint64_t j=0; j<thisLen; ++j) {
-      ansi64[ thisCounts[(*source - minULL) >> shift]++ ] = *source;
+      const uint64_t k = fskey(xp, type, desc, from+j);
+      ans[ thisCounts[(k - minULL) >> shift]++ ] = k;
       // This assignment to ans is not random access as it may seem, but cache efficient by
       // design since target pages are written to contiguously. MSBsize * 4k < cache.
       // TODO: therefore 16 bit MSB seems too big for this step. Time this step and reduce 16 a lot.
       //       20MB cache / nth / 4k => MSBsize=160
-      source++;
     }
   }
   // Done with batches now. Will not use batch dimension again.
@@ -247,7 +286,7 @@ SEXP fsort(SEXP x, SEXP verboseArg) {
     // sort bins by size, largest first to minimise last-man-home
     uint64_t *msbCounts = counts + (nBatch-1)*MSBsize;
     // msbCounts currently contains the ending position of each MSB (the starting location of the next) even across empty
-    if (msbCounts[MSBsize-1] != xlength(x)) internal_error(__func__, "counts[nBatch-1][MSBsize-1] != length(x)"); // # nocov
+    if (msbCounts[MSBsize-1] != n) internal_error(__func__, "counts[nBatch-1][MSBsize-1] != length(x)"); // # nocov
     uint64_t *msbFrom = (uint64_t *)R_alloc(MSBsize, sizeof(uint64_t));
     int *order = (int *)R_alloc(MSBsize, sizeof(int));
     uint64_t cumSum = 0;
@@ -277,7 +316,7 @@ SEXP fsort(SEXP x, SEXP verboseArg) {
       if (!mycounts) {
         failed=true; alloc_fail=true;  // # nocov
       }
-      double *restrict myworking = NULL;
+      uint64_t *restrict myworking = NULL;
       // the working memory for the largest group per thread is allocated when the thread receives its first iteration
       int myfirstmsb = -1;  // for the monotonicity check
 
@@ -300,7 +339,7 @@ SEXP fsort(SEXP x, SEXP verboseArg) {
         uint64_t thisN = msbCounts[order[msb]];
 
         if (myworking==NULL) {
-          myworking = malloc(thisN * sizeof(double));
+          myworking = malloc(thisN * sizeof(uint64_t));
           if (!myworking) {
             failed=true; alloc_fail=true; continue;  // # nocov
           }
@@ -340,8 +379,51 @@ SEXP fsort(SEXP x, SEXP verboseArg) {
   //       After a few years of heavy use remove this check for speed, and move into unit tests.
   //       It's a perfectly contiguous and cache efficient parallel scan so should be relatively negligible.
 
-  double tot = t[7]-t[0];
-  if (verbose) for (int i=1; i<=7; ++i) {
+  // untwiddle the keys back to values. The NAs are first: NA (key 0) then, for doubles, NaN (key 1). They're moved to the end when
+  // na.last=TRUE, or dropped when na.last=NA which needs a new result vector
+  R_xlen_t nNA=0;
+  while (nNA<nna && ans[nNA]==0) nNA++;
+  const R_xlen_t nout = nalast==NA_LOGICAL ? n-nna : n;
+  if (nout<n) { ansVec = PROTECT(allocVector(TYPEOF(x), nout)); nprotect++; }
+  const bool inplace = type!=FS_INT && nout==n;  // then untwiddle where they are and shift afterwards; otherwise write to ansVec directly
+  const R_xlen_t offset = inplace ? 0 : (nalast==TRUE || nalast==NA_LOGICAL ? -nna : 0);
+  int *ansi = type==FS_INT ? INTEGER(ansVec) : NULL;
+  int64_t *ansi64 = type==FS_INT64 ? (int64_t *)REAL(ansVec) : NULL;
+  double *ansd = type==FS_DOUBLE ? REAL(ansVec) : NULL;
+  #pragma omp parallel for num_threads(nth)
+  for (R_xlen_t i=nna; i<n; ++i) {
+    const uint64_t k = ans[i];
+    switch(type) {
+    case FS_INT: {
+      const int v = (int)(uint32_t)(k ^ 0x80000000);
+      ansi[offset+i] = desc ? -v : v;
+    } break;
+    case FS_INT64: {
+      const int64_t v = (int64_t)(k ^ SIGN64);
+      ansi64[offset+i] = desc ? -v : v;
+    } break;
+    default: {
+      union {double d; uint64_t u64;} u;
+      u.u64 = (k & SIGN64) ? k ^ SIGN64 : ~k;
+      ansd[offset+i] = desc ? -u.d : u.d;
+    }}
+  }
+  if (nout==n) {
+    if (inplace && nalast==TRUE) memmove(ans, ans+nna, (n-nna)*sizeof(uint64_t));
+    const R_xlen_t from = nalast==TRUE ? n-nna : 0;
+    for (R_xlen_t i=from; i<from+nna; ++i) {
+      switch(type) {
+      case FS_INT:   ansi[i] = NA_INTEGER; break;
+      case FS_INT64: ansi64[i] = NA_INTEGER64; break;
+      default:       ansd[i] = i-from<nNA ? NA_REAL : R_NaN;
+      }
+    }
+  }
+  copyMostAttrib(x, ansVec);  // e.g. factor levels, Date and integer64 class
+  t[8] = wallclock();
+
+  double tot = t[8]-t[0];
+  if (verbose) for (int i=1; i<=8; ++i) {
     Rprintf(_("%d: %.3f (%4.1f%%)\n"), i, t[i]-t[i-1], 100.*(t[i]-t[i-1])/tot);
   }
   UNPROTECT(nprotect);
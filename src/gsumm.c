@@ -4,7 +4,7 @@
 static int ngrp = 0;         // number of groups
 static int *grpsize = NULL;  // size of each group, used by gmean (and gmedian) not gsum
 static int nrow = 0;         // length of underlying x; same as length(ghigh) and length(glow)
-static int *irows;           // GForce support for subsets in 'i' (TODO: joins in 'i')
+static int *irows;           // GForce support for subsets in 'i', and joins in 'i' with by=.EACHI where NA marks a nomatch=NA row
 static int irowslen = -1;    // -1 is for irows = NULL
 static uint16_t *high=NULL, *low=NULL;  // the group of each x item; a.k.a. which-group-am-I
 static int *restrict grp;    // TODO: eventually this can be made local for gforce as won't be needed globally when all functions here use gather
@@ -21,6 +21,19 @@ static int *oo = NULL;
 static int *ff = NULL;
 static int isunsorted = 0;
 
+// for fused reductions over the same column; see gfusedinit() and gfused() below
+typedef struct {
+  SEXP x;            // the double column, as found in gforce's env
+  bool var, done;    // var: var or sd was requested which needs the extra passes; done: statistics computed
+  double *sum, *sumnarm, *min, *max, *minnarm, *maxnarm;
+  int *nna;          // number of non-NA per group
+  long double *m, *v;
+} gfused_t;
+static gfused_t *fused = NULL;
+static int nfused = 0;
+static bool compensated = false;  // options(datatable.gsum.compensated=TRUE), for gsum and gmean of double
+static bool deterministic = false;  // options(datatable.deterministic=TRUE), no long double; see GetDeterministic()
+
 // from R's src/cov.c (for variance / sd)
 #ifdef HAVE_LONG_DOUBLE
 # define SQRTL sqrtl
@@ -37,6 +50,62 @@ static int nbit(int n)
   return nb;
 }
 
+/*
+  When j applies several of sum, mean, min, max, var and sd to the same double column, e.g.
+    DT[, .(sum(x), mean(x), min(x), max(x), sd(x)), by=g], each g* function would gather and scan x on its own.
+    Instead, such columns are noted here before j is evaluated. The first of those g* calls to run then gathers
+    the column once and computes the statistics for all of them in one pass over the high/low batch layout,
+    sharing the NA tracking; see gfused(). The remaining calls just take their result from there.
+*/
+static void gfusedinit(SEXP env, SEXP jsub)
+{
+  nfused = 0;
+  if (!isLanguage(jsub) || CAR(jsub)!=install("list")) return;
+  const int nargs = length(jsub)-1;
+  if (nargs<2) return;
+  SEXP fusable[6] = { install("gsum"), install("gmean"), install("gmin"), install("gmax"), install("gvar"), install("gsd") };
+  SEXP *cols = (SEXP *)R_alloc(nargs, sizeof(SEXP));
+  bool *var = (bool *)R_alloc(nargs, sizeof(bool));
+  int ncols = 0;
+  for (SEXP a=CDR(jsub); a!=R_NilValue; a=CDR(a)) {
+    SEXP q = CAR(a);
+    if (!isLanguage(q) || length(q)<2 || !isSymbol(CADR(q))) continue;
+    int f=0;
+    while (f<6 && CAR(q)!=fusable[f]) f++;
+    if (f==6) continue;
+    var[ncols] = f>=4;
+    cols[ncols++] = CADR(q);
+  }
+  for (int i=0; i<ncols; ++i) {
+    if (cols[i]==NULL) continue;
+    bool wantvar = var[i];
+    int n = 1;
+    for (int j=i+1; j<ncols; ++j) if (cols[j]==cols[i]) {
+      n++;
+      wantvar |= var[j];
+      cols[j] = NULL;  // count each column once
+    }
+    if (n<2) continue;
+    SEXP x = findVarInFrame(env, cols[i]);
+    if (TYPEOF(x)!=REALSXP || INHERITS(x, char_integer64)) continue;  // int sum has overflow handling and int64 its own arithmetic; left to the g* functions
+    if (!fused) fused = (gfused_t *)R_alloc(nargs, sizeof(gfused_t));
+    gfused_t *f = fused + nfused++;
+    f->x = x;
+    f->var = wantvar;
+    f->done = false;
+    // allocated here rather than in gfused() because R_alloc memory is released when the g* .Call returns, whereas this lives until gforce returns
+    f->sum = (double *)R_alloc(6*(size_t)ngrp, sizeof(double));
+    f->sumnarm = f->sum + ngrp;
+    f->min = f->sumnarm + ngrp;
+    f->max = f->min + ngrp;
+    f->minnarm = f->max + ngrp;
+    f->maxnarm = f->minnarm + ngrp;
+    f->nna = (int *)R_alloc(ngrp, sizeof(int));
+    f->m = wantvar ? (long double *)R_alloc(2*(size_t)ngrp, sizeof(long double)) : NULL;
+    f->v = wantvar ? f->m + ngrp : NULL;
+  }
+}
+
 /*
   Functions with GForce optimization are internally parallelized to speed up
     grouped summaries over a large data.table. OpenMP is used here to
@@ -205,7 +274,16 @@ SEXP gforce(SEXP env, SEXP jsub, SEXP o, SEXP f, SEXP l, SEXP irowsArg) {
   oo = INTEGER(o);
   ff = INTEGER(f);
 
+  SEXP opt = GetOption(install("datatable.gsum.compensated"), R_NilValue);
+  deterministic = GetDeterministic();
+  compensated = deterministic || (isLogical(opt) && LENGTH(opt)==1 && LOGICAL(opt)[0]==TRUE);
+  fused = NULL;
+  nfused = 0;  // also here, as an error in a previous eval(jsub) leaves it set
+  if (!compensated) gfusedinit(env, jsub);  // the fused pass sums without compensation, and var in long double
+  if (verbose && nfused) Rprintf(_("gforce will fuse reductions over %d column(s)\n"), nfused);
+
   SEXP ans = PROTECT( eval(jsub, env) );
+  nfused = 0;
   if (verbose) { Rprintf(_("gforce eval took %.3f\n"), wallclock()-started); started=wallclock(); }
   // if this eval() fails with R error, R will release grp for us. Which is why we use R_alloc above.
   if (isVectorAtomic(ans)) {
@@ -345,6 +423,148 @@ void *gather(SEXP x, bool *anyNA)
   return gx;
 }
 
+static gfused_t *gfused(SEXP x)
+{
+  // returns NULL unless x was noted by gfusedinit(), otherwise its statistics, computed on the first call
+  int k=0;
+  while (k<nfused && fused[k].x!=x) k++;
+  if (k==nfused) return NULL;
+  gfused_t *f = fused + k;
+  if (f->done) return f;
+  double started = wallclock();
+  const bool verbose = GetVerbose();
+  bool anyNA = false;
+  const double *restrict gx = gather(x, &anyNA);
+  double *restrict sum=f->sum, *restrict sumnarm=f->sumnarm, *restrict mn=f->min, *restrict mx=f->max, *restrict mnnarm=f->minnarm, *restrict mxnarm=f->maxnarm;
+  int *restrict nna = f->nna;
+  long double *restrict m = f->m, *restrict v = f->v;
+  for (int i=0; i<ngrp; ++i) {
+    sum[i] = sumnarm[i] = 0.0;
+    mn[i] = R_PosInf; mx[i] = R_NegInf;
+    mnnarm[i] = mxnarm[i] = NA_REAL;
+    nna[i] = 0;
+  }
+  if (f->var) for (int i=0; i<ngrp; ++i) m[i] = v[i] = 0.0;
+  // each group is accumulated in row order and with the same arithmetic as gsum, gmean, gminmax and gvarsd1 so that results are identical
+  #pragma omp parallel for num_threads(getDTthreads(highSize, false))
+  for (int h=0; h<highSize; h++) {
+    const int off = h<<bitshift;
+    double *restrict _sum=sum+off, *restrict _sumnarm=sumnarm+off, *restrict _mn=mn+off, *restrict _mx=mx+off, *restrict _mnnarm=mnnarm+off, *restrict _mxnarm=mxnarm+off;
+    int *restrict _nna = nna+off;
+    long double *restrict _m = f->var ? m+off : NULL;
+    for (int b=0; b<nBatch; b++) {
+      const int pos = counts[ b*highSize + h ];
+      const int howMany = ((h==highSize-1) ? (b==nBatch-1?lastBatchSize:batchSize) : counts[ b*highSize + h + 1 ]) - pos;
+      const double *my_gx = gx + b*batchSize + pos;
+      const uint16_t *my_low = low + b*batchSize + pos;
+      for (int i=0; i<howMany; i++) {
+        const int g = my_low[i];
+        const double elem = my_gx[i];
+        _sum[g] += elem;  // let NA propagate as gsum when !narm
+        if (!ISNAN(_mn[g]) && (ISNAN(elem) || elem<_mn[g])) _mn[g] = elem;     // the first NA observed stays, as gminmax
+        if (!ISNAN(_mx[g]) && (ISNAN(elem) || !(elem<_mx[g]))) _mx[g] = elem;
+        if (ISNAN(elem)) continue;
+        _sumnarm[g] += elem;
+        _nna[g]++;
+        if (ISNAN(_mnnarm[g]) || elem<_mnnarm[g]) _mnnarm[g] = elem;
+        if (ISNAN(_mxnarm[g]) || !(elem<_mxnarm[g])) _mxnarm[g] = elem;
+        if (_m) _m[g] += elem;
+      }
+    }
+  }
+  if (f->var) {
+    // the two further passes of gvarsd1: residuals to correct the mean, then the sum of squares
+    for (int pass=0; pass<2; ++pass) {
+      for (int i=0; i<ngrp; ++i) {
+        if (pass==0) m[i] = m[i]/nna[i];
+        else { m[i] += v[i]/nna[i]; v[i] = 0.0; }
+      }
+      #pragma omp parallel for num_threads(getDTthreads(highSize, false))
+      for (int h=0; h<highSize; h++) {
+        const int off = h<<bitshift;
+        const long double *restrict _m = m+off;
+        long double *restrict _v = v+off;
+        for (int b=0; b<nBatch; b++) {
+          const int pos = counts[ b*highSize + h ];
+          const int howMany = ((h==highSize-1) ? (b==nBatch-1?lastBatchSize:batchSize) : counts[ b*highSize + h + 1 ]) - pos;
+          const double *my_gx = gx + b*batchSize + pos;
+          const uint16_t *my_low = low + b*batchSize + pos;
+          for (int i=0; i<howMany; i++) {
+            const double elem = my_gx[i];
+            if (ISNAN(elem)) continue;
+            const int g = my_low[i];
+            if (pass==0) _v[g] += (elem-_m[g]);
+            else _v[g] += (elem-(double)_m[g]) * (elem-(double)_m[g]);
+          }
+        }
+      }
+    }
+  }
+  f->done = true;
+  if (verbose) Rprintf(_("gforce fused reductions over one column took %.3fs\n"), wallclock()-started);
+  return f;
+}
+
+enum {GFUSED_SUM, GFUSED_MEAN, GFUSED_MIN, GFUSED_MAX, GFUSED_VAR, GFUSED_SD};
+
+static SEXP gfusedans(SEXP x, int stat, bool narm)
+{
+  // the result of the g* function for stat taken from the fused statistics of x, or NULL when x is not fused
+  const gfused_t *f = gfused(x);
+  if (!f || (stat>=GFUSED_VAR && !f->var)) return NULL;
+  SEXP ans = PROTECT(allocVector(REALSXP, ngrp));
+  double *ansd = REAL(ans);
+  for (int i=0; i<ngrp; ++i) {
+    switch(stat) {
+    case GFUSED_SUM:  ansd[i] = narm ? f->sumnarm[i] : f->sum[i]; break;
+    case GFUSED_MEAN: ansd[i] = narm ? f->sumnarm[i]/f->nna[i] : f->sum[i]/grpsize[i]; break;
+    case GFUSED_MIN:  ansd[i] = narm ? f->minnarm[i] : f->min[i]; break;
+    case GFUSED_MAX:  ansd[i] = narm ? f->maxnarm[i] : f->max[i]; break;
+    default:
+      if (grpsize[i]==1 || (f->nna[i]!=grpsize[i] && (!narm || f->nna[i]<=1))) { ansd[i] = NA_REAL; break; }
+      ansd[i] = (double)f->v[i]/(f->nna[i]-1);
+      if (stat==GFUSED_SD) ansd[i] = SQRTL(ansd[i]);
+    }
+  }
+  if (stat<GFUSED_VAR) copyMostAttrib(x, ans);  // as gsum, gmean and gminmax; not gvarsd1
+  UNPROTECT(1);
+  return ans;
+}
+
+/*
+  Kahan-Neumaier compensated sum of each group's values (skipping NA and NaN when narm) into ansp, for gsum and gmean of
+  double when options(datatable.gsum.compensated=TRUE). The error of each addition is accumulated separately per group
+  and added back at the end, so the result is as accurate as summing in extended precision but stays in double, which
+  vectorises and on some platforms (e.g. aarch64) long double does not provide anyway. As the plain sum, each group is
+  summed in row order by one thread so the result does not depend on the number of threads. nna, when not NULL,
+  counts the values summed in each group, for gmean.
+*/
+static void gsumcomp(const double *gx, double *ansp, int *nna, const bool narm)
+{
+  double *comp = calloc(ngrp, sizeof(double));
+  if (!comp) error(_("Unable to allocate %d * %zu bytes for compensation terms in gsum"), ngrp, sizeof(double)); // # nocov
+  #pragma omp parallel for num_threads(getDTthreads(highSize, false))
+  for (int h=0; h<highSize; h++) {
+    double *restrict _ans = ansp + (h<<bitshift), *restrict _comp = comp + (h<<bitshift);
+    int *restrict _nna = nna ? nna + (h<<bitshift) : NULL;
+    for (int b=0; b<nBatch; b++) {
+      const int pos = counts[ b*highSize + h ];
+      const int howMany = ((h==highSize-1) ? (b==nBatch-1?lastBatchSize:batchSize) : counts[ b*highSize + h + 1 ]) - pos;
+      const double *my_gx = gx + b*batchSize + pos;
+      const uint16_t *my_low = low + b*batchSize + pos;
+      for (int i=0; i<howMany; i++) {
+        const double v = my_gx[i];
+        if (narm && ISNAN(v)) continue;
+        const int g = my_low[i];
+        DSUM_ADD(_ans[g], _comp[g], v);
+        if (_nna) _nna[g]++;
+      }
+    }
+  }
+  for (int i=0; i<ngrp; i++) ansp[i] = DSUM_GET(ansp[i], comp[i]);  // NA, NaN and Inf are left as the plain sum has them
+  free(comp);
+}
+
 SEXP gsum(SEXP x, SEXP narmArg)
 {
   if (!IS_TRUE_OR_FALSE(narmArg))
@@ -357,8 +577,13 @@ SEXP gsum(SEXP x, SEXP narmArg)
   const bool verbose=GetVerbose();
   if (verbose) Rprintf(_("This gsum (narm=%s) took ... "), narm?"TRUE":"FALSE");
   if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gsum");
-  bool anyNA=false;
   SEXP ans;
+  if ((ans = gfusedans(x, GFUSED_SUM, narm))) {
+    if (verbose) Rprintf(_("%.3fs (fused)\n"), wallclock()-started);
+    return ans;
+  }
+  bool anyNA=false;
+  double gathered = 0;  // for the verbose breakdown of the double case
   switch(TYPEOF(x)) {
   case LGLSXP: case INTSXP: {
     const int *restrict gx = gather(x, &anyNA);
@@ -438,10 +663,13 @@ SEXP gsum(SEXP x, SEXP narmArg)
   case REALSXP: {
     if (!INHERITS(x, char_integer64)) {
       const double *restrict gx = gather(x, &anyNA);
+      gathered = wallclock();
       ans = PROTECT(allocVector(REALSXP, ngrp));
       double *restrict ansp = REAL(ans);
       memset(ansp, 0, ngrp*sizeof(double));
-      if (!narm || !anyNA) {
+      if (compensated) {
+        gsumcomp(gx, ansp, NULL, narm);
+      } else if (!narm || !anyNA) {
         #pragma omp parallel for num_threads(getDTthreads(highSize, false))
         for (int h=0; h<highSize; h++) {
           double *restrict _ans = ansp + (h<<bitshift);
@@ -574,7 +802,10 @@ SEXP gsum(SEXP x, SEXP narmArg)
     error(_("Type '%s' is not supported by GForce %s. Either add the prefix %s or turn off GForce optimization using options(datatable.optimize=1)"), type2char(TYPEOF(x)), "sum (gsum)", "base::sum(.)");
   }
   copyMostAttrib(x, ans);
-  if (verbose) { Rprintf(_("%.3fs\n"), wallclock()-started); }
+  if (verbose) {
+    if (gathered>0) Rprintf(_("%.3fs (gather %.3fs, %s sum %.3fs)\n"), wallclock()-started, gathered-started, compensated?"compensated":"plain", wallclock()-gathered);
+    else Rprintf(_("%.3fs\n"), wallclock()-started);
+  }
   UNPROTECT(1);
   return(ans);
 }
@@ -591,8 +822,13 @@ SEXP gmean(SEXP x, SEXP narmArg)
   const bool verbose=GetVerbose();
   if (verbose) Rprintf(_("This gmean took (narm=%s) ... "), narm?"TRUE":"FALSE"); // narm=TRUE only at this point
   if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gmean");
-  bool anyNA=false;
   SEXP ans=R_NilValue;
+  if ((ans = gfusedans(x, GFUSED_MEAN, narm))) {
+    if (verbose) Rprintf(_("%.3fs (fused)\n"), wallclock()-started);
+    return ans;
+  }
+  bool anyNA=false;
+  double gathered = 0;  // for the verbose breakdown
   int protecti=0;
   switch(TYPEOF(x)) {
   case LGLSXP: case INTSXP:
@@ -604,10 +840,19 @@ SEXP gmean(SEXP x, SEXP narmArg)
       UNPROTECT(2); PROTECT(x); // PROTECT() is stack-based, UNPROTECT() back to 'as' then PROTECT() 'x' again
     }
     const double *restrict gx = gather(x, &anyNA);
+    gathered = wallclock();
     ans = PROTECT(allocVector(REALSXP, ngrp)); protecti++;
     double *restrict ansp = REAL(ans);
     memset(ansp, 0, ngrp*sizeof(double));
-    if (!narm || !anyNA) {
+    if (compensated) {
+      int *restrict nna_counts = NULL;
+      if (narm && anyNA && !(nna_counts = calloc(ngrp, sizeof(int))))
+        error(_("Unable to allocate %d * %zu bytes for non-NA counts in gmean na.rm=TRUE"), ngrp, sizeof(int)); // # nocov
+      gsumcomp(gx, ansp, nna_counts, narm);
+      #pragma omp parallel for num_threads(getDTthreads(ngrp, true))
+      for (int i=0; i<ngrp; i++) ansp[i] /= nna_counts ? nna_counts[i] : grpsize[i];
+      free(nna_counts);
+    } else if (!narm || !anyNA) {
       #pragma omp parallel for num_threads(getDTthreads(highSize, false))
       for (int h=0; h<highSize; h++) {
         double *restrict _ans = ansp + (h<<bitshift);
@@ -722,7 +967,10 @@ SEXP gmean(SEXP x, SEXP narmArg)
     error(_("Type '%s' not supported by GForce mean (gmean). Either add the prefix base::mean(.) or turn off GForce optimization using options(datatable.optimize=1)"), type2char(TYPEOF(x)));
   }
   copyMostAttrib(x, ans);
-  if (verbose) { Rprintf(_("%.3fs\n"), wallclock()-started); }
+  if (verbose) {
+    if (gathered>0) Rprintf(_("%.3fs (gather %.3fs, %s sum %.3fs)\n"), wallclock()-started, gathered-started, compensated?"compensated":"plain", wallclock()-gathered);
+    else Rprintf(_("%.3fs\n"), wallclock()-started);
+  }
   UNPROTECT(protecti);
   return(ans);
 }
@@ -739,6 +987,7 @@ static SEXP gminmax(SEXP x, SEXP narm, const bool min)
   //clock_t start = clock();
   SEXP ans;
   if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gminmax");
+  if ((ans = gfusedans(x, min ? GFUSED_MIN : GFUSED_MAX, LOGICAL(narm)[0]))) return ans;
   // GForce guarantees each group has at least one value; i.e. we don't need to consider length-0 per group here
   switch(TYPEOF(x)) {
   case LGLSXP: case INTSXP: {
@@ -864,6 +1113,53 @@ SEXP gmax(SEXP x, SEXP narm)
   return gminmax(x, narm, false);
 }
 
+// gmedian and gquantile: p<0 for the median, otherwise the type 7 quantile at p. Groups are spread across threads, each of which
+// collects the non-NA values of a group into its own scratch buffer for quickselect. *anyNA is set when a group with an NA
+// was given NA because of !narm
+static SEXP gselect(SEXP x, const bool narm, const double p, bool *anyNA)
+{
+  const bool isInt64 = INHERITS(x, char_integer64), isInt = TYPEOF(x)!=REALSXP, median = p<0;
+  const bool nosubset = irowslen==-1;
+  SEXP ans = PROTECT(allocVector(REALSXP, ngrp));
+  double *ansd = REAL(ans);
+  const int *xi = isInt ? INTEGER(x) : NULL;
+  const double *xd = isInt ? NULL : REAL(x);
+  const int64_t *xi64 = isInt ? NULL : (const int64_t *)REAL(x);
+  bool failed = false;
+  #pragma omp parallel num_threads(getDTthreads(ngrp, true))
+  {
+    void *sub = malloc((maxgrpn+1) * (isInt ? sizeof(int) : sizeof(double)));  // each thread's own, reused for each of its groups
+    if (!sub) failed = true;  // # nocov
+    #pragma omp for schedule(dynamic, 64)
+    for (int i=0; i<ngrp; ++i) {
+      if (failed) continue;
+      const int thisgrpsize = grpsize[i];
+      int nna = 0;  // how many not-NA
+      bool grpNA = false;
+      for (int j=0; j<thisgrpsize; ++j) {
+        int k = ff[i]+j-1;
+        if (isunsorted) k = oo[k]-1;
+        k = nosubset ? k : (irows[k]==NA_INTEGER ? NA_INTEGER : irows[k]-1);
+        if (isInt) {
+          if (k==NA_INTEGER || xi[k]==NA_INTEGER) grpNA = true;
+          else ((int *)sub)[nna++] = xi[k];
+        } else {
+          if (k==NA_INTEGER || (isInt64 ? xi64[k]==NA_INTEGER64 : ISNAN(xd[k]))) grpNA = true;
+          else ((double *)sub)[nna++] = xd[k];
+        }
+      }
+      if (grpNA && !narm) { ansd[i] = NA_REAL; *anyNA = true; continue; }
+      // all-NA is returned as NA_REAL via n==0 case inside *quickselect and *quantile
+      if (median) ansd[i] = isInt ? iquickselect(sub, nna) : (isInt64 ? i64quickselect(sub, nna) : dquickselect(sub, nna));
+      else        ansd[i] = isInt ? iquantile(sub, nna, p) : dquantile(sub, nna, p);
+    }
+    free(sub);
+  }
+  if (failed) error(_("Failed to allocate working memory for GForce %s"), median ? "median" : "quantile"); // # nocov
+  UNPROTECT(1);
+  return ans;
+}
+
 // gmedian, always returns numeric type (to avoid as.numeric() wrap..)
 SEXP gmedian(SEXP x, SEXP narmArg) {
   if (!IS_TRUE_OR_FALSE(narmArg))
@@ -874,48 +1170,141 @@ SEXP gmedian(SEXP x, SEXP narmArg) {
   const bool isInt64 = INHERITS(x, char_integer64), narm = LOGICAL(narmArg)[0];
   const int n = (irowslen == -1) ? length(x) : irowslen;
   if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gmedian");
-  SEXP ans = PROTECT(allocVector(REALSXP, ngrp));
-  double *ansd = REAL(ans);
-  const bool nosubset = irowslen==-1;
+  if (!isInteger(x) && !isLogical(x) && !isReal(x))
+    error(_("Type '%s' is not supported by GForce %s. Either add the prefix %s or turn off GForce optimization using options(datatable.optimize=1)"), type2char(TYPEOF(x)), "median (gmedian)", "stats::median(.)");
+  bool anyNA = false;
+  SEXP ans = PROTECT(gselect(x, narm, -1.0, &anyNA));
+  if (!isInt64) copyMostAttrib(x, ans);
+  // else the integer64 class needs to be dropped since double is always returned by gmedian
+  UNPROTECT(1);
+  return ans;
+}
+
+// gquantile, for a single probability and type 7 only, which [.data.table checks; always returns numeric as stats::quantile
+SEXP gquantile(SEXP x, SEXP probsArg, SEXP narmArg) {
+  if (!IS_TRUE_OR_FALSE(narmArg))
+    error(_("%s must be TRUE or FALSE"), "na.rm");
+  if (!isVectorAtomic(x)) error(_("GForce quantile can only be applied to columns, not .SD or similar. Either add the prefix stats::quantile(.) or turn off GForce optimization using options(datatable.optimize=1)"));
+  if (!isReal(probsArg) || LENGTH(probsArg)!=1 || ISNAN(REAL(probsArg)[0]) || REAL(probsArg)[0]<0 || REAL(probsArg)[0]>1)
+    error(_("GForce quantile requires a single probability between 0 and 1"));
+  const int n = (irowslen == -1) ? length(x) : irowslen;
+  if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gquantile");
+  if (isFactor(x))
+    error(_("%s is not meaningful for factors."), "quantile");
+  if ((!isInteger(x) && !isLogical(x) && !isReal(x)) || INHERITS(x, char_integer64))
+    error(_("Type '%s' is not supported by GForce %s. Either add the prefix %s or turn off GForce optimization using options(datatable.optimize=1)"), INHERITS(x, char_integer64) ? "integer64" : type2char(TYPEOF(x)), "quantile (gquantile)", "stats::quantile(.)");
+  bool anyNA = false;
+  SEXP ans = PROTECT(gselect(x, LOGICAL(narmArg)[0], REAL(probsArg)[0], &anyNA));
+  if (anyNA) error(_("missing values and NaN's not allowed if 'na.rm' is FALSE"));  // as stats::quantile
+  UNPROTECT(1);
+  return ans;
+}
+
+static int cmp_uint64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x>y) - (x<y);
+}
+
+/*
+  uniqueN by group. Each value is mapped to a 64bit key which is equal for equal values in the sense of forder: via dtwiddle
+  for doubles, so that -0 and 0 are the same and NA and NaN are different (and setNumericRounding applies), and via the
+  CHARSXP address for strings once they are all in UTF-8. The exact count sorts each group's keys and counts the runs. With
+  approx=p, groups of more than 2^p values are instead counted by a HyperLogLog sketch of 2^p registers, whose relative
+  standard error is about 1.04/sqrt(2^p). Smaller groups are counted exactly since that is no slower than the sketch.
+  Groups are spread across threads, each with its own buffers.
+*/
+SEXP guniqueN(SEXP x, SEXP narmArg, SEXP approxArg) {
+  if (!IS_TRUE_OR_FALSE(narmArg))
+    error(_("%s must be TRUE or FALSE"), "na.rm");
+  if (!isVectorAtomic(x)) error(_("GForce uniqueN can only be applied to columns, not .SD or similar. To count the unique rows of .SD, either add the prefix data.table::uniqueN(.SD) or turn off GForce optimization using options(datatable.optimize=1)"));
+  if (!isInteger(approxArg) || LENGTH(approxArg)!=1 || (INTEGER(approxArg)[0]!=0 && (INTEGER(approxArg)[0]<4 || INTEGER(approxArg)[0]>18)))
+    error(_("approx must be TRUE, FALSE or a precision between 4 and 18"));
+  const bool narm = LOGICAL(narmArg)[0];
+  const int prec = INTEGER(approxArg)[0], nreg = prec ? 1<<prec : 0;
+  const int n = (irowslen == -1) ? length(x) : irowslen;
+  if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "guniqueN");
+  int nprotect = 0;
+  enum {UN_INT, UN_DOUBLE, UN_INT64, UN_STRING} type;
+  const void *xp;
   switch(TYPEOF(x)) {
-  case REALSXP: {
-    double *subd = REAL(PROTECT(allocVector(REALSXP, maxgrpn))); // allocate once upfront and reuse
-    int64_t *xi64 = (int64_t *)REAL(x);
-    double  *xd = REAL(x);
-    for (int i=0; i<ngrp; ++i) {
-      int thisgrpsize = grpsize[i], nacount=0;
-      for (int j=0; j<thisgrpsize; ++j) {
-        int k = ff[i]+j-1;
-        if (isunsorted) k = oo[k]-1;
-        k = nosubset ? k : (irows[k]==NA_INTEGER ? NA_INTEGER : irows[k]-1);
-        if (k==NA_INTEGER || (isInt64 ? xi64[k]==NA_INTEGER64 : ISNAN(xd[k]))) nacount++;
-        else subd[j-nacount] = xd[k];
-      }
-      thisgrpsize -= nacount;  // all-NA is returned as NA_REAL via n==0 case inside *quickselect
-      ansd[i] = (nacount && !narm) ? NA_REAL : (isInt64 ? i64quickselect((void *)subd, thisgrpsize) : dquickselect(subd, thisgrpsize));
-    }}
+  case LGLSXP: case INTSXP:
+    type = UN_INT; xp = INTEGER_RO(x);
     break;
-  case LGLSXP: case INTSXP: {
-    int *subi = INTEGER(PROTECT(allocVector(INTSXP, maxgrpn)));
-    int *xi = INTEGER(x);
-    for (int i=0; i<ngrp; i++) {
+  case REALSXP:
+    type = INHERITS(x, char_integer64) ? UN_INT64 : UN_DOUBLE; xp = REAL_RO(x);
+    break;
+  case STRSXP: {
+    const SEXP *xd = STRING_PTR_RO(x);
+    int i=0;
+    while (i<length(x) && !NEED2UTF8(xd[i])) i++;
+    if (i<length(x)) {
+      // translate so that equal strings are the same CHARSXP; as forder does
+      SEXP tt = PROTECT(allocVector(STRSXP, length(x))); nprotect++;
+      for (int j=0; j<length(x); ++j) SET_STRING_ELT(tt, j, ENC2UTF8(xd[j]));
+      xd = STRING_PTR_RO(tt);
+    }
+    type = UN_STRING; xp = xd;
+  } break;
+  default:
+    error(_("Type '%s' is not supported by GForce %s. Either add the prefix %s or turn off GForce optimization using options(datatable.optimize=1)"), type2char(TYPEOF(x)), "uniqueN (guniqueN)", "data.table::uniqueN(.)");
+  }
+  const bool nosubset = irowslen==-1;
+  SEXP ans = PROTECT(allocVector(INTSXP, ngrp)); nprotect++;
+  int *ansd = INTEGER(ans);
+  bool failed = false;
+  #pragma omp parallel num_threads(getDTthreads(ngrp, true))
+  {
+    uint64_t *keys = malloc(((prec ? MIN(maxgrpn, nreg) : maxgrpn) + 1) * sizeof(uint64_t));
+    uint8_t *reg = prec ? malloc(nreg) : NULL;
+    if (!keys || (prec && !reg)) failed = true;  // # nocov
+    #pragma omp for schedule(dynamic, 256)
+    for (int i=0; i<ngrp; ++i) {
+      if (failed) continue;
       const int thisgrpsize = grpsize[i];
-      int nacount=0;
+      const bool sketch = prec && thisgrpsize>nreg;
+      if (sketch) memset(reg, 0, nreg);
+      int nk = 0;
       for (int j=0; j<thisgrpsize; ++j) {
         int k = ff[i]+j-1;
         if (isunsorted) k = oo[k]-1;
-        if (nosubset ? xi[k]==NA_INTEGER : (irows[k]==NA_INTEGER || (k=irows[k]-1,xi[k]==NA_INTEGER))) nacount++;
-        else subi[j-nacount] = xi[k];
+        if (!nosubset) k = irows[k]==NA_INTEGER ? -1 : irows[k]-1;  // -1: nomatch row of a join, NA
+        uint64_t key;
+        bool isna;
+        switch(type) {
+        case UN_INT:    { const int v = k<0 ? NA_INTEGER : ((const int *)xp)[k]; isna = v==NA_INTEGER; key = (uint32_t)v; } break;
+        case UN_DOUBLE: { const double v = k<0 ? NA_REAL : ((const double *)xp)[k]; isna = ISNAN(v); key = dtwiddle(v); } break;
+        case UN_INT64:  { const int64_t v = k<0 ? NA_INTEGER64 : ((const int64_t *)xp)[k]; isna = v==NA_INTEGER64; key = (uint64_t)v; } break;
+        default:        { const SEXP v = k<0 ? NA_STRING : ((const SEXP *)xp)[k]; isna = v==NA_STRING; key = (uint64_t)(uintptr_t)v; }
+        }
+        if (isna && narm) continue;
+        if (!sketch) { keys[nk++] = key; continue; }
+        const uint64_t h = mix64(key);
+        uint64_t w = h << prec;
+        uint8_t rho = 1;  // position of the first 1 bit after the register bits
+        while (rho<=64-prec && !(w & 0x8000000000000000ULL)) { w<<=1; rho++; }
+        if (rho>reg[h>>(64-prec)]) reg[h>>(64-prec)] = rho;
+        nk++;
       }
-      ansd[i] = (nacount && !narm) ? NA_REAL : iquickselect(subi, thisgrpsize-nacount);
-    }}
-    break;
-  default:
-    error(_("Type '%s' is not supported by GForce %s. Either add the prefix %s or turn off GForce optimization using options(datatable.optimize=1)"), type2char(TYPEOF(x)), "median (gmedian)", "stats::median(.)");
+      if (!sketch) {
+        qsort(keys, nk, sizeof(uint64_t), cmp_uint64);
+        int count = nk>0;
+        for (int j=1; j<nk; ++j) count += keys[j]!=keys[j-1];
+        ansd[i] = count;
+      } else {
+        double sum = 0.0;
+        int zeros = 0;
+        for (int j=0; j<nreg; ++j) { sum += ldexp(1.0, -reg[j]); zeros += reg[j]==0; }
+        const double alpha = nreg==16 ? 0.673 : nreg==32 ? 0.697 : nreg==64 ? 0.709 : 0.7213/(1.0+1.079/nreg);
+        double est = alpha*nreg*(double)nreg/sum;
+        if (est<=2.5*nreg && zeros) est = nreg*log((double)nreg/zeros);  // linear counting for small cardinalities
+        ansd[i] = (int)MIN(nearbyint(est), (double)nk);
+      }
+    }
+    free(keys);
+    free(reg);
   }
-  if (!isInt64) copyMostAttrib(x, ans);
-  // else the integer64 class needs to be dropped since double is always returned by gmedian
-  UNPROTECT(2);  // ans, subd|subi
+  if (failed) error(_("Failed to allocate working memory for GForce uniqueN")); // # nocov
+  UNPROTECT(nprotect);
   return ans;
 }
 
@@ -1019,6 +1408,21 @@ SEXP gnthvalue(SEXP x, SEXP nArg) {
 
 // TODO: gwhich.min, gwhich.max
 // implemented this similar to gmedian to balance well between speed and memory usage. There's one extra allocation on maximum groups and that's it.. and that helps speed things up extremely since we don't have to collect x's values for each group for each step (mean, residuals, mean again and then variance).
+// the two-pass variance of gvarsd1 in double with compensated sums rather than long double, for options(datatable.deterministic=TRUE)
+static double dvariance(const void *sub, const bool isInt, const int n)
+{
+  #define SUBD(j) (isInt ? (double)((const int *)sub)[j] : ((const double *)sub)[j])
+  double m=0., mc=0.;
+  for (int j=0; j<n; ++j) { const double v = SUBD(j); DSUM_ADD(m, mc, v); }
+  double mean = DSUM_GET(m, mc)/n, r=0., rc=0.;
+  for (int j=0; j<n; ++j) { const double d = SUBD(j)-mean; DSUM_ADD(r, rc, d); }
+  mean += DSUM_GET(r, rc)/n;
+  double v=0., vc=0.;
+  for (int j=0; j<n; ++j) { volatile double d = (SUBD(j)-mean)*(SUBD(j)-mean); const double dd = d; DSUM_ADD(v, vc, dd); }  // volatile: no fma
+  #undef SUBD
+  return DSUM_GET(v, vc)/(n-1);
+}
+
 static SEXP gvarsd1(SEXP x, SEXP narmArg, bool isSD)
 {
   if (!IS_TRUE_OR_FALSE(narmArg))
@@ -1028,10 +1432,12 @@ static SEXP gvarsd1(SEXP x, SEXP narmArg, bool isSD)
     error(_("%s is not meaningful for factors."), isSD ? "sd" : "var");
   const int n = (irowslen == -1) ? length(x) : irowslen;
   if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gvar");
-  SEXP sub, ans = PROTECT(allocVector(REALSXP, ngrp));
+  const bool narm = LOGICAL(narmArg)[0];
+  SEXP sub, ans;
+  if ((ans = gfusedans(x, isSD ? GFUSED_SD : GFUSED_VAR, narm))) return ans;
+  ans = PROTECT(allocVector(REALSXP, ngrp));
   double *ansd = REAL(ans);
   const bool nosubset = irowslen==-1;
-  const bool narm = LOGICAL(narmArg)[0];
   switch(TYPEOF(x)) {
   case LGLSXP: case INTSXP: {
     sub = PROTECT(allocVector(INTSXP, maxgrpn)); // allocate once upfront
@@ -1053,6 +1459,7 @@ static SEXP gvarsd1(SEXP x, SEXP narmArg, bool isSD)
           m += (subd[nna++]=xd[ix]); // sum
         }
         if (nna!=thisgrpsize && (!narm || nna<=1)) { ansd[i]=NA_REAL; continue; }
+        if (deterministic) { ansd[i] = dvariance(subd, TYPEOF(x)!=REALSXP, nna); if (isSD) ansd[i] = sqrt(ansd[i]); continue; }
         m = m/nna; // mean, first pass
         for (int j=0; j<nna; ++j) s += (subd[j]-m); // residuals
         m += (s/nna); // mean, second pass
@@ -1084,6 +1491,7 @@ static SEXP gvarsd1(SEXP x, SEXP narmArg, bool isSD)
           m += (subd[nna++]=xd[ix]); // sum
         }
         if (nna!=thisgrpsize && (!narm || nna<=1)) { ansd[i]=NA_REAL; continue; }
+        if (deterministic) { ansd[i] = dvariance(subd, TYPEOF(x)!=REALSXP, nna); if (isSD) ansd[i] = sqrt(ansd[i]); continue; }
         m = m/nna; // mean, first pass
         for (int j=0; j<nna; ++j) s += (subd[j]-m); // residuals
         m += (s/nna); // mean, second pass
@@ -1138,7 +1546,7 @@ SEXP gprod(SEXP x, SEXP narmArg) {
         if (!narm) s[thisgrp] = NA_REAL;  // Let NA_REAL propagate from here. R_NaReal is IEEE.
         continue;
       }
-      s[thisgrp] *= elem; // no under/overflow here, s is long double (like base)
+      s[thisgrp] = deterministic ? (double)s[thisgrp]*elem : s[thisgrp]*elem; // no under/overflow here, s is long double (like base)
     }}
     break;
   case REALSXP: {
@@ -1151,7 +1559,7 @@ SEXP gprod(SEXP x, SEXP narmArg) {
           if (!narm) s[thisgrp] = NA_REAL;
           continue;
         }
-        s[thisgrp] *= elem;
+        s[thisgrp] = deterministic ? (double)s[thisgrp]*elem : s[thisgrp]*elem;
       }
     } else {
       const double *xd = REAL(x);
@@ -1162,7 +1570,7 @@ SEXP gprod(SEXP x, SEXP narmArg) {
           if (!narm) s[thisgrp] = NA_REAL;
           continue;
         }
-        s[thisgrp] *= elem;
+        s[thisgrp] = deterministic ? (double)s[thisgrp]*elem : s[thisgrp]*elem;
       }
     }
   } break;
@@ -1283,3 +1691,444 @@ SEXP gshift(SEXP x, SEXP nArg, SEXP fillArg, SEXP typeArg) {
   return isVectorAtomic(x) && length(ans) == 1 ? VECTOR_ELT(ans, 0) : ans;
 }
 
+
+/*
+  Thread-safe native group functions. A package whose j calls one of its own routines via .Call(C_f, col1, col2, ...)
+  can also register, from its R_init_<dll>, a re-entrant variant of C_f which makes no R API calls:
+    double f(const double **x, int ncol, int n)
+  where x[j] points to the n values of the j-th column argument for one group, gathered contiguously (integer and
+  logical columns are given as double with NA as NA_REAL). GForce then calls it for the groups in parallel, each
+  thread gathering into its own buffer, instead of dogroups evaluating j once per group. See ?cdt.
+  Variants are keyed by the DLL name (as in useDynLib() and R_init_<dll>, and C_f$dll$name) and the routine's
+  registered name (C_f$name), which is what [.data.table sees of C_f.
+*/
+#define MAXGROUPFUNS 256
+static struct { char dll[64], name[128]; DT_groupfun_t fun; } groupfuns[MAXGROUPFUNS];
+static int ngroupfuns = 0;
+
+static int groupfun_find(const char *dll, const char *name)
+{
+  for (int i=0; i<ngroupfuns; ++i) if (!strcmp(groupfuns[i].dll, dll) && !strcmp(groupfuns[i].name, name)) return i;
+  return -1;
+}
+
+void DT_register_groupfun(const char *dll, const char *name, DT_groupfun_t fun)
+{
+  if (strlen(dll)>=sizeof(groupfuns[0].dll) || strlen(name)>=sizeof(groupfuns[0].name))
+    error(_("DLL or routine name too long to register '%s' as a thread-safe group function"), name);
+  int i = groupfun_find(dll, name);
+  if (i==-1) {
+    if (ngroupfuns==MAXGROUPFUNS) error(_("Cannot register more than %d thread-safe group functions"), MAXGROUPFUNS);
+    i = ngroupfuns++;
+    strcpy(groupfuns[i].dll, dll);
+    strcpy(groupfuns[i].name, name);
+  }
+  groupfuns[i].fun = fun;  // re-registering replaces, e.g. when a package is reloaded
+}
+
+SEXP groupfunRegistered(SEXP dll, SEXP name)
+{
+  if (!ngroupfuns || !isString(dll) || LENGTH(dll)!=1 || !isString(name) || LENGTH(name)!=1) return ScalarLogical(FALSE);
+  return ScalarLogical(groupfun_find(CHAR(STRING_ELT(dll, 0)), CHAR(STRING_ELT(name, 0)))!=-1);
+}
+
+SEXP gnative(SEXP dll, SEXP name, SEXP cols)
+{
+  if (!isString(dll) || LENGTH(dll)!=1 || !isString(name) || LENGTH(name)!=1) internal_error(__func__, "dll and name must be single strings"); // # nocov
+  const int w = groupfun_find(CHAR(STRING_ELT(dll, 0)), CHAR(STRING_ELT(name, 0)));
+  if (w==-1) error(_("'%s' in DLL '%s' is not registered as a thread-safe group function"), CHAR(STRING_ELT(name, 0)), CHAR(STRING_ELT(dll, 0)));
+  const DT_groupfun_t fun = groupfuns[w].fun;
+  if (!isNewList(cols) || !length(cols)) internal_error(__func__, "cols is not a non-empty list"); // # nocov
+  const int ncol = length(cols);
+  const int n = (irowslen == -1) ? length(VECTOR_ELT(cols, 0)) : irowslen;
+  if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gnative");
+  const void **xp = (const void **)R_alloc(ncol, sizeof(void *));
+  bool *isInt = (bool *)R_alloc(ncol, sizeof(bool));
+  for (int j=0; j<ncol; ++j) {
+    SEXP x = VECTOR_ELT(cols, j);
+    if (length(x)!=length(VECTOR_ELT(cols, 0))) error(_("All arguments of the thread-safe group function '%s' must be columns of the same length"), CHAR(STRING_ELT(name, 0)));
+    if (isFactor(x) || INHERITS(x, char_integer64) || (!isInteger(x) && !isLogical(x) && !isReal(x)))
+      error(_("Type '%s' is not supported by thread-safe group functions, which are given columns of type integer, logical or double"), isFactor(x) ? "factor" : INHERITS(x, char_integer64) ? "integer64" : type2char(TYPEOF(x)));
+    isInt[j] = !isReal(x);
+    xp[j] = isInt[j] ? (const void *)INTEGER_RO(x) : (const void *)REAL_RO(x);
+  }
+  const bool nosubset = irowslen==-1;
+  SEXP ans = PROTECT(allocVector(REALSXP, ngrp));
+  double *ansd = REAL(ans);
+  bool failed = false;
+  #pragma omp parallel num_threads(getDTthreads(ngrp, true))
+  {
+    double *buf = malloc(((size_t)maxgrpn*ncol+1) * sizeof(double));  // each thread's own, reused for each of its groups
+    const double **x = malloc(ncol * sizeof(double *));
+    if (!buf || !x) failed = true;  // # nocov
+    else for (int j=0; j<ncol; ++j) x[j] = buf + (size_t)j*maxgrpn;
+    #pragma omp for schedule(dynamic, 64)
+    for (int i=0; i<ngrp; ++i) {
+      if (failed) continue;
+      const int thisgrpsize = grpsize[i];
+      for (int j=0; j<ncol; ++j) {
+        double *col = (double *)x[j];
+        for (int r=0; r<thisgrpsize; ++r) {
+          int k = ff[i]+r-1;
+          if (isunsorted) k = oo[k]-1;
+          k = nosubset ? k : (irows[k]==NA_INTEGER ? NA_INTEGER : irows[k]-1);
+          if (k==NA_INTEGER) col[r] = NA_REAL;
+          else if (isInt[j]) { const int v = ((const int *)xp[j])[k]; col[r] = v==NA_INTEGER ? NA_REAL : v; }
+          else col[r] = ((const double *)xp[j])[k];
+        }
+      }
+      ansd[i] = fun(x, ncol, thisgrpsize);
+    }
+    free(buf); free(x);
+  }
+  if (failed) error(_("Failed to allocate working memory for GForce %s"), "thread-safe group function"); // # nocov
+  UNPROTECT(1);
+  return ans;
+}
+
+/*
+  gfroll: frollmean and frollsum by group. Each group's values are gathered into a per-thread buffer and passed to the
+  same froll.c kernels as frollfunR, which write straight into the group's slice of the answer, so the answer is one
+  column (one per window width) in group order, as gshift. Groups are done in parallel; the kernels' own parallelism
+  (algo="exact") then runs single-threaded within each. As frollfunR, fill, align, na.rm and hasNA apply within each
+  group, and with adaptive=TRUE, n is a column giving the window width for each row.
+*/
+SEXP gfroll(SEXP fun, SEXP x, SEXP k, SEXP fill, SEXP algo, SEXP align, SEXP narm, SEXP hasna, SEXP adaptive) {
+  const int n = (irowslen == -1) ? length(x) : irowslen;
+  if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gfroll");
+  if (!isVectorAtomic(x) || isFactor(x) || INHERITS(x, char_integer64) || (!isReal(x) && !isInteger(x) && !isLogical(x)))
+    error(_("x must be of type numeric or logical, or a list, data.frame or data.table of such"));
+  if (!IS_TRUE_OR_FALSE(adaptive))
+    error(_("%s must be TRUE or FALSE"), "adaptive");
+  const bool badaptive = LOGICAL(adaptive)[0];
+  if (!IS_TRUE_OR_FALSE(narm))
+    error(_("%s must be TRUE or FALSE"), "na.rm");
+  if (!isLogical(hasna) || length(hasna)!=1)
+    error(_("hasNA must be TRUE, FALSE or NA"));
+  if (LOGICAL(hasna)[0]==FALSE && LOGICAL(narm)[0])
+    error(_("using hasNA FALSE and na.rm TRUE does not make sense, if you know there are NA values use hasNA TRUE, otherwise leave it as default NA"));
+  const bool bnarm = LOGICAL(narm)[0];
+  const int ihasna = LOGICAL(hasna)[0]==NA_LOGICAL ? 0 : LOGICAL(hasna)[0]==TRUE ? 1 : -1;
+  const int ialign = !strcmp(CHAR(STRING_ELT(align, 0)), "right") ? 1 : !strcmp(CHAR(STRING_ELT(align, 0)), "center") ? 0 : -1;
+  if (badaptive && ialign!=1)
+    error(_("using adaptive TRUE and align argument different than 'right' is not implemented"));
+  const unsigned int ialgo = GetDeterministic() ? 2 : !strcmp(CHAR(STRING_ELT(algo, 0)), "exact");  // 2 is frolldet
+  const bool mean = !strcmp(CHAR(STRING_ELT(fun, 0)), "mean");
+  if (length(fill) != 1)
+    error(_("fill must be a vector of length 1"));
+  if (!isInteger(fill) && !isReal(fill) && !isLogical(fill))
+    error(_("fill must be numeric or logical"));
+  int nprotect = 0;
+  const double dfill = REAL(PROTECT(coerceAs(fill, PROTECT(ScalarReal(NA_REAL)), ScalarLogical(true))))[0]; nprotect+=2;
+
+  int nk = 1;
+  const int *ik = NULL;  // the window widths, or the column of them when adaptive
+  if (!isInteger(k) && !isReal(k)) error(badaptive ? _("n must be integer vector or list of integer vectors") : _("n must be integer"));
+  if (isReal(k)) { k = PROTECT(coerceVector(k, INTSXP)); nprotect++; }
+  ik = INTEGER(k);
+  if (!badaptive) {
+    nk = length(k);
+    if (nk==0) error(_("n must be non 0 length"));
+    for (int j=0; j<nk; ++j) if (ik[j]==NA_INTEGER || ik[j]<=0) error(_("n must be positive integer values (> 0)"));
+  } else if (length(k)!=length(x)) {
+    error(_("length of integer vector(s) provided as list to 'n' argument must be equal to number of observations provided in 'x'"));
+  }
+
+  SEXP ans = PROTECT(allocVector(VECSXP, nk)); nprotect++;
+  double **ansd = (double **)R_alloc(nk, sizeof(double *));
+  for (int j=0; j<nk; ++j) ansd[j] = REAL(SET_VECTOR_ELT(ans, j, allocVector(REALSXP, nrow)));
+  int *off = (int *)R_alloc(ngrp, sizeof(int));  // where each group's values start in the answer
+  for (int i=0, cum=0; i<ngrp; cum+=grpsize[i++]) off[i] = cum;
+
+  const bool isInt = !isReal(x), nosubset = irowslen==-1;
+  const int *xi = isInt ? INTEGER(x) : NULL;
+  const double *xd = isInt ? NULL : REAL(x);
+  const int nth = getDTthreads(ngrp, true);
+  ans_t *res = (ans_t *)R_alloc(nth, sizeof(ans_t));  // the worst outcome in each thread, for ansMsg
+  for (int t=0; t<nth; ++t) { res[t].status = 0; for (int m=0; m<4; ++m) res[t].message[m][0] = '\0'; }
+  bool failed = false;
+  #pragma omp parallel num_threads(nth)
+  {
+    double *sub = malloc(((size_t)maxgrpn+1) * sizeof(double));           // each thread's own, reused for each of its groups
+    int *subk = badaptive ? malloc(((size_t)maxgrpn+1) * sizeof(int)) : NULL;
+    ans_t *a = malloc(sizeof(ans_t));
+    if (!sub || !a || (badaptive && !subk)) failed = true;  // # nocov
+    ans_t *worst = res + omp_get_thread_num();
+    #pragma omp for schedule(dynamic, 64)
+    for (int i=0; i<ngrp; ++i) {
+      if (failed) continue;
+      const int thisgrpsize = grpsize[i];
+      for (int j=0; j<thisgrpsize; ++j) {
+        int r = ff[i]+j-1;
+        if (isunsorted) r = oo[r]-1;
+        r = nosubset ? r : (irows[r]==NA_INTEGER ? NA_INTEGER : irows[r]-1);
+        sub[j] = r==NA_INTEGER ? NA_REAL : (isInt ? (xi[r]==NA_INTEGER ? NA_REAL : xi[r]) : xd[r]);
+        if (badaptive) subk[j] = r==NA_INTEGER ? 1 : ik[r];
+      }
+      for (int w=0; w<nk; ++w) {
+        a->dbl_v = ansd[w] + off[i];
+        a->status = 0;
+        for (int m=0; m<4; ++m) a->message[m][0] = '\0';
+        if (badaptive) {
+          if (mean) fadaptiverollmean(ialgo, sub, thisgrpsize, a, subk, dfill, bnarm, ihasna, false);
+          else      fadaptiverollsum(ialgo, sub, thisgrpsize, a, subk, dfill, bnarm, ihasna, false);
+        } else {
+          if (mean) frollmean(ialgo, sub, thisgrpsize, a, ik[w], ialign, dfill, bnarm, ihasna, false);
+          else      frollsum(ialgo, sub, thisgrpsize, a, ik[w], ialign, dfill, bnarm, ihasna, false);
+        }
+        if (a->status > worst->status) *worst = *a;  // the first warning or error in this thread is reported, once
+        if (a->status == 3) failed = true;
+      }
+    }
+    free(sub); free(subk); free(a);
+  }
+  if (failed) {
+    bool err = false;
+    for (int t=0; t<nth; ++t) err |= res[t].status == 3;
+    if (!err) error(_("Failed to allocate working memory for GForce %s"), mean ? "frollmean" : "frollsum"); // # nocov
+  }
+  ansMsg(res, nth, false, mean ? "gfrollmean" : "gfrollsum");
+  UNPROTECT(nprotect);
+  // as gshift and frollfunR: the list is stripped when there is one window
+  return nk==1 ? VECTOR_ELT(ans, 0) : ans;
+}
+
+/*
+  gcum: cumsum, cumprod, cummin and cummax within each group, and grank: rank within each group. As gshift and gfroll
+  they return one value per row, in group order, and the groups are done in parallel. Results follow base R: integer
+  and logical input gives integer except for cumprod, NA (and NaN for double) propagates to the end of the group, and
+  integer overflow in cumsum gives NA with a warning. Also as base, cumsum and cumprod accumulate in long double, other
+  than with options(datatable.deterministic=TRUE) where each step is rounded to double as in gprod.
+*/
+enum {GCUMSUM, GCUMPROD, GCUMMIN, GCUMMAX};
+
+SEXP gcum(SEXP x, SEXP opArg) {
+  const int n = (irowslen == -1) ? length(x) : irowslen;
+  if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gcum");
+  const int op = INTEGER(opArg)[0];
+  const char *opname = op==GCUMSUM ? "cumsum" : op==GCUMPROD ? "cumprod" : op==GCUMMIN ? "cummin" : "cummax";
+  if (isFactor(x) || INHERITS(x, char_integer64) || (!isInteger(x) && !isLogical(x) && !isReal(x)))
+    error(_("Type '%s' is not supported by GForce %s. Either add the prefix %s or turn off GForce optimization using options(datatable.optimize=1)"),
+          isFactor(x) ? "factor" : INHERITS(x, char_integer64) ? "integer64" : type2char(TYPEOF(x)), opname, "base::");
+  const bool isInt = !isReal(x), intAns = isInt && op!=GCUMPROD, nosubset = irowslen==-1;
+  const int *xi = isInt ? INTEGER(x) : NULL;
+  const double *xd = isInt ? NULL : REAL(x);
+  SEXP ans = PROTECT(allocVector(intAns ? INTSXP : REALSXP, nrow));
+  int *ansi = intAns ? INTEGER(ans) : NULL;
+  double *ansd = intAns ? NULL : REAL(ans);
+  int *off = (int *)R_alloc(ngrp, sizeof(int));
+  for (int i=0, cum=0; i<ngrp; cum+=grpsize[i++]) off[i] = cum;
+  bool overflow = false;
+  #pragma omp parallel for num_threads(getDTthreads(ngrp, true)) schedule(dynamic, 64)
+  for (int i=0; i<ngrp; ++i) {
+    const int thisgrpsize = grpsize[i];
+    bool na = false;
+    long double acc = op==GCUMSUM ? 0.0 : op==GCUMPROD ? 1.0 : op==GCUMMIN ? R_PosInf : R_NegInf;
+    for (int j=0; j<thisgrpsize; ++j) {
+      int k = ff[i]+j-1;
+      if (isunsorted) k = oo[k]-1;
+      k = nosubset ? k : (irows[k]==NA_INTEGER ? NA_INTEGER : irows[k]-1);
+      const int a = off[i]+j;
+      if (isInt) {
+        const int v = k==NA_INTEGER ? NA_INTEGER : xi[k];
+        if (v==NA_INTEGER) na = true;
+        if (!na) {
+          switch(op) {
+          case GCUMSUM:  acc += v; if (acc>INT_MAX || acc<=INT_MIN) { na = true; overflow = true; } break;
+          case GCUMPROD: acc = deterministic ? (double)acc*v : acc*v; break;
+          case GCUMMIN:  if (v<acc) acc = v; break;
+          default:       if (v>acc) acc = v;
+          }
+        }
+        if (intAns) ansi[a] = na ? NA_INTEGER : (int)acc;
+        else        ansd[a] = na ? NA_REAL : (double)acc;
+      } else {
+        const double v = k==NA_INTEGER ? NA_REAL : xd[k];
+        switch(op) {
+        case GCUMSUM:  acc = deterministic ? (double)acc+v : acc+v; break;
+        case GCUMPROD: acc = deterministic ? (double)acc*v : acc*v; break;
+        // as base R, once NA or NaN is seen it is carried to the end of the group
+        case GCUMMIN:  acc = (ISNAN(v) || ISNAN((double)acc)) ? acc+v : (v<acc ? v : acc); break;
+        default:       acc = (ISNAN(v) || ISNAN((double)acc)) ? acc+v : (v>acc ? v : acc);
+        }
+        ansd[a] = (double)acc;
+      }
+    }
+  }
+  if (overflow) warning(_("integer overflow in 'cumsum'; use 'cumsum(as.numeric(.))'"));
+  UNPROTECT(1);
+  return ans;
+}
+
+// stable merge sort of idx[0..n) by v[idx]; tmp is scratch of the same size
+static void gmsort(int *idx, int *tmp, const double *v, int n)
+{
+  for (int w=1; w<n; w*=2) {
+    for (int lo=0; lo<n; lo+=2*w) {
+      const int mid = MIN(lo+w, n), hi = MIN(lo+2*w, n);
+      int a=lo, b=mid, t=lo;
+      while (a<mid && b<hi) tmp[t++] = v[idx[b]]<v[idx[a]] ? idx[b++] : idx[a++];
+      while (a<mid) tmp[t++] = idx[a++];
+      while (b<hi) tmp[t++] = idx[b++];
+    }
+    memcpy(idx, tmp, n*sizeof(int));
+  }
+}
+
+// rank(x, ties.method=, na.last=) within each group, for ties.method "average", "first", "min" and "max", and
+// na.last TRUE (NA ranked last in order of appearance) or "keep"; as base::rank, "average" returns double
+SEXP grank(SEXP x, SEXP tiesArg, SEXP nalastArg) {
+  const int n = (irowslen == -1) ? length(x) : irowslen;
+  if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "grank");
+  if (isFactor(x) || INHERITS(x, char_integer64) || (!isInteger(x) && !isLogical(x) && !isReal(x)))
+    error(_("Type '%s' is not supported by GForce %s. Either add the prefix %s or turn off GForce optimization using options(datatable.optimize=1)"),
+          isFactor(x) ? "factor" : INHERITS(x, char_integer64) ? "integer64" : type2char(TYPEOF(x)), "rank", "base::");
+  const char *ties = CHAR(STRING_ELT(tiesArg, 0));
+  enum {AVERAGE, FIRST, MIN, MAX} tm = !strcmp(ties, "first") ? FIRST : !strcmp(ties, "min") ? MIN : !strcmp(ties, "max") ? MAX : AVERAGE;
+  const bool keep = LOGICAL(nalastArg)[0]==NA_LOGICAL;  // na.last="keep" is passed as NA
+  const bool isInt = !isReal(x), nosubset = irowslen==-1;
+  const int *xi = isInt ? INTEGER(x) : NULL;
+  const double *xd = isInt ? NULL : REAL(x);
+  SEXP ans = PROTECT(allocVector(tm==AVERAGE ? REALSXP : INTSXP, nrow));
+  double *ansd = tm==AVERAGE ? REAL(ans) : NULL;
+  int *ansi = tm==AVERAGE ? NULL : INTEGER(ans);
+  int *off = (int *)R_alloc(ngrp, sizeof(int));
+  for (int i=0, cum=0; i<ngrp; cum+=grpsize[i++]) off[i] = cum;
+  bool failed = false;
+  #pragma omp parallel num_threads(getDTthreads(ngrp, true))
+  {
+    double *v = malloc(((size_t)maxgrpn+1) * sizeof(double));  // each thread's own, reused for each of its groups
+    int *idx = malloc(((size_t)maxgrpn+1) * sizeof(int)), *tmp = malloc(((size_t)maxgrpn+1) * sizeof(int));
+    if (!v || !idx || !tmp) failed = true;  // # nocov
+    #pragma omp for schedule(dynamic, 64)
+    for (int i=0; i<ngrp; ++i) {
+      if (failed) continue;
+      const int thisgrpsize = grpsize[i], a = off[i];
+      int nok = 0;
+      for (int j=0; j<thisgrpsize; ++j) {
+        int k = ff[i]+j-1;
+        if (isunsorted) k = oo[k]-1;
+        k = nosubset ? k : (irows[k]==NA_INTEGER ? NA_INTEGER : irows[k]-1);
+        v[j] = k==NA_INTEGER ? NA_REAL : (isInt ? (xi[k]==NA_INTEGER ? NA_REAL : xi[k]) : xd[k]);
+        if (!ISNAN(v[j])) idx[nok++] = j;
+      }
+      gmsort(idx, tmp, v, nok);
+      for (int s=0; s<nok; ) {
+        int e = s+1;
+        if (tm!=FIRST) while (e<nok && v[idx[e]]==v[idx[s]]) e++;
+        for (int t=s; t<e; ++t) {
+          if (tm==AVERAGE) ansd[a+idx[t]] = (s+1+e)/2.0;
+          else ansi[a+idx[t]] = tm==FIRST ? t+1 : tm==MIN ? s+1 : e;
+        }
+        s = e;
+      }
+      for (int j=0, r=nok; j<thisgrpsize; ++j) if (ISNAN(v[j])) {
+        r++;
+        if (tm==AVERAGE) ansd[a+j] = keep ? NA_REAL : r;
+        else ansi[a+j] = keep ? NA_INTEGER : r;
+      }
+    }
+    free(v); free(idx); free(tmp);
+  }
+  if (failed) error(_("Failed to allocate working memory for GForce %s"), "rank"); // # nocov
+  UNPROTECT(1);
+  return ans;
+}
+
+/*
+  gtopk: head(sort(x, decreasing=), n) and head(order(x, decreasing=), n) by group, i.e. the n smallest or largest
+  values of each group in order, or their positions within the group. Rather than ordering the whole group, the n
+  are selected with quickselect, O(grpsize), and only those n are then sorted. Ties are broken by position so the
+  positions are those of base::order, which is stable; NA and NaN come last in order of appearance, as na.last=TRUE.
+*/
+static inline bool tkbefore(const double *v, const int a, const int b, const bool dec)
+{
+  return v[a]!=v[b] ? (dec ? v[a]>v[b] : v[a]<v[b]) : a<b;
+}
+
+// rearranges idx[0..n) so that its first k (0<k<=n) come before all the others, in no particular order
+static void tkselect(int *idx, int n, const int k, const double *v, const bool dec)
+{
+  int lo=0, hi=n-1;
+  while (lo<hi) {
+    const int p = idx[lo+(hi-lo)/2];
+    int i=lo, j=hi;
+    while (i<=j) {
+      while (tkbefore(v, idx[i], p, dec)) i++;
+      while (tkbefore(v, p, idx[j], dec)) j--;
+      if (i<=j) { const int t=idx[i]; idx[i++]=idx[j]; idx[j--]=t; }
+    }
+    if (k-1<=j) hi=j; else if (k-1>=i) lo=i; else break;
+  }
+}
+
+// merge sort of idx[0..n) by tkbefore; tmp is scratch of the same size
+static void tksort(int *idx, int *tmp, const int n, const double *v, const bool dec)
+{
+  for (int w=1; w<n; w*=2) {
+    for (int lo=0; lo<n; lo+=2*w) {
+      const int mid = MIN(lo+w, n), hi = MIN(lo+2*w, n);
+      int a=lo, b=mid, t=lo;
+      while (a<mid && b<hi) tmp[t++] = tkbefore(v, idx[b], idx[a], dec) ? idx[b++] : idx[a++];
+      while (a<mid) tmp[t++] = idx[a++];
+      while (b<hi) tmp[t++] = idx[b++];
+    }
+    memcpy(idx, tmp, n*sizeof(int));
+  }
+}
+
+SEXP gtopk(SEXP x, SEXP nArg, SEXP decArg, SEXP indexArg) {
+  const int n = (irowslen == -1) ? length(x) : irowslen;
+  if (nrow != n) error(_("nrow [%d] != length(x) [%d] in %s"), nrow, n, "gtopk");
+  if (!isInteger(nArg) || LENGTH(nArg)!=1 || INTEGER(nArg)[0]<1) error(_("GForce head(sort(.), n) and head(order(.), n) are only implemented for n>0; use utils::head or options(datatable.optimize=1)"));
+  if (isFactor(x) || INHERITS(x, char_integer64) || (!isInteger(x) && !isReal(x)))
+    error(_("Type '%s' is not supported by GForce %s. Either add the prefix %s or turn off GForce optimization using options(datatable.optimize=1)"),
+          isFactor(x) ? "factor" : INHERITS(x, char_integer64) ? "integer64" : type2char(TYPEOF(x)), "head(sort(.))", "utils::");
+  const int topn = INTEGER(nArg)[0];
+  const bool dec = LOGICAL(decArg)[0]==TRUE, index = LOGICAL(indexArg)[0]==TRUE;
+  const bool isInt = isInteger(x), nosubset = irowslen==-1;
+  const int *xi = isInt ? INTEGER(x) : NULL;
+  const double *xd = isInt ? NULL : REAL(x);
+  int *off = (int *)R_alloc(ngrp, sizeof(int));
+  int anslen = 0;
+  for (int i=0; i<ngrp; ++i) { off[i] = anslen; anslen += MIN(topn, grpsize[i]); }
+  SEXP ans = PROTECT(allocVector(index || isInt ? INTSXP : REALSXP, anslen));
+  int *ansi = index || isInt ? INTEGER(ans) : NULL;
+  double *ansd = ansi ? NULL : REAL(ans);
+  bool failed = false;
+  #pragma omp parallel num_threads(getDTthreads(ngrp, true))
+  {
+    double *v = malloc(((size_t)maxgrpn+1) * sizeof(double));  // each thread's own, reused for each of its groups
+    int *idx = malloc(((size_t)maxgrpn+1) * sizeof(int)), *tmp = malloc(((size_t)MIN(topn, maxgrpn)+1) * sizeof(int));
+    if (!v || !idx || !tmp) failed = true;  // # nocov
+    #pragma omp for schedule(dynamic, 64)
+    for (int i=0; i<ngrp; ++i) {
+      if (failed) continue;
+      const int thisgrpsize = grpsize[i], m = MIN(topn, thisgrpsize);
+      int nok = 0;
+      for (int j=0; j<thisgrpsize; ++j) {
+        int k = ff[i]+j-1;
+        if (isunsorted) k = oo[k]-1;
+        k = nosubset ? k : (irows[k]==NA_INTEGER ? NA_INTEGER : irows[k]-1);
+        v[j] = k==NA_INTEGER ? NA_REAL : (isInt ? (xi[k]==NA_INTEGER ? NA_REAL : xi[k]) : xd[k]);
+        if (!ISNAN(v[j])) idx[nok++] = j;
+      }
+      const int mok = MIN(m, nok);
+      if (mok<nok) tkselect(idx, nok, mok, v, dec);
+      tksort(idx, tmp, mok, v, dec);
+      for (int j=0, r=mok; r<m; ++j) if (ISNAN(v[j])) idx[r++] = j;
+      int *ai = ansi ? ansi+off[i] : NULL;
+      double *ad = ansd ? ansd+off[i] : NULL;
+      for (int r=0; r<m; ++r) {
+        if (index) ai[r] = idx[r]+1;
+        else if (isInt) ai[r] = ISNAN(v[idx[r]]) ? NA_INTEGER : (int)v[idx[r]];
+        else ad[r] = v[idx[r]];
+      }
+    }
+    free(v); free(idx); free(tmp);
+  }
+  if (failed) error(_("Failed to allocate working memory for GForce %s"), "head(sort(.))"); // # nocov
+  if (!index) copyMostAttrib(x, ans);
+  UNPROTECT(1);
+  return ans;
+}
@@ -0,0 +1,253 @@
+#include "data.table.h"
+
+/*
+  A hash table from CHARSXP (by address) to int, used instead of stashing values in the TRUELENGTH of the global
+  CHARSXP cache. Writing to TRUELENGTH means saving and restoring R's own usage of it (savetl), that only one
+  table can exist at a time, and that nothing can run in parallel with it, not even another data.table call. Here
+  the table is private to its caller, and lookups only read it so can be done from many threads at once.
+
+  Open addressing with linear probing. The table is split into partitions by the hash so that hash_build() can fill
+  each partition from its own thread without locking: each key is hashed once, the positions are partitioned by a
+  count and scatter pass (as hashgroup() does with rows), and each thread then inserts just its own partition's keys.
+  The scatter keeps the positions in order within each partition, so each key is mapped to its first position as it
+  would be in a single pass. Partitions grow
+  independently, so memory is proportional to the number of distinct keys rather than the number of keys.
+
+  Memory is malloc'd, not R_alloc'd, so that it can grow and be used from threads; callers must hash_free(), including
+  before any error(). NULL, or false from hash_set(), is returned when out of memory.
+*/
+
+typedef struct {
+  size_t mask, n;  // slots-1, and the number of keys
+  SEXP *keys;      // NULL is an empty slot; CHARSXP are never NULL
+  int *values;
+} hashpart_t;
+
+struct hashtab {
+  int npart;
+  hashpart_t *part;
+};
+
+static inline uint64_t keyhash(SEXP key)
+{
+  return mix64((uint64_t)(uintptr_t)key);
+}
+
+static inline int partof(const hashtab_t *h, uint64_t hv)
+{
+  // the top 32 bits pick the partition, the bottom bits the slot within it, so they're independent
+  return h->npart==1 ? 0 : (int)(((hv>>32) * (uint64_t)h->npart) >> 32);
+}
+
+static bool part_alloc(hashpart_t *p, size_t n)
+{
+  size_t cap = 16;
+  while (cap < 2*n) cap <<= 1;
+  p->keys = calloc(cap, sizeof(SEXP));
+  p->values = malloc(cap*sizeof(int));
+  p->mask = cap-1;
+  p->n = 0;
+  return p->keys && p->values;
+}
+
+static bool part_grow(hashpart_t *p)
+{
+  hashpart_t new;
+  if (!part_alloc(&new, p->mask+1)) { free(new.keys); free(new.values); return false; } // # nocov
+  for (size_t k=0; k<=p->mask; ++k) {
+    const SEXP key = p->keys[k];
+    if (!key) continue;
+    size_t j = keyhash(key) & new.mask;
+    while (new.keys[j]) j = (j+1) & new.mask;
+    new.keys[j] = key;
+    new.values[j] = p->values[k];
+  }
+  new.n = p->n;
+  free(p->keys); free(p->values);
+  *p = new;
+  return true;
+}
+
+// the slot holding key, or the empty slot where it would go
+static inline size_t part_slot(const hashpart_t *p, SEXP key, uint64_t hv)
+{
+  size_t k = hv & p->mask;
+  while (p->keys[k] && p->keys[k]!=key) k = (k+1) & p->mask;
+  return k;
+}
+
+// insert key with value if not already present; overwrite the existing value if overwrite
+static bool part_insert(hashpart_t *p, SEXP key, uint64_t hv, int value, bool overwrite)
+{
+  size_t k = part_slot(p, key, hv);
+  if (p->keys[k]) {
+    if (overwrite) p->values[k] = value;
+    return true;
+  }
+  if (2*(p->n+1) > p->mask+1) {  // keep the load factor at most 1/2
+    if (!part_grow(p)) return false; // # nocov
+    k = part_slot(p, key, hv);
+  }
+  p->keys[k] = key;
+  p->values[k] = value;
+  p->n++;
+  return true;
+}
+
+static hashtab_t *hash_alloc(int npart, size_t n)
+{
+  hashtab_t *h = malloc(sizeof(hashtab_t));
+  if (!h) return NULL; // # nocov
+  h->npart = npart;
+  h->part = calloc(npart, sizeof(hashpart_t));
+  bool ok = h->part!=NULL;
+  for (int p=0; ok && p<npart; ++p) ok = part_alloc(h->part+p, n/npart);
+  if (!ok) { hash_free(h); return NULL; } // # nocov
+  return h;
+}
+
+hashtab_t *hash_create(size_t n)
+{
+  // n is a guide to the number of keys; the table grows as needed
+  return hash_alloc(1, n);
+}
+
+void hash_free(hashtab_t *h)
+{
+  if (!h) return;
+  if (h->part) for (int p=0; p<h->npart; ++p) { free(h->part[p].keys); free(h->part[p].values); }
+  free(h->part);
+  free(h);
+}
+
+bool hash_set(hashtab_t *h, SEXP key, int value)
+{
+  // not thread safe; use hash_build() to fill a table in parallel
+  const uint64_t hv = keyhash(key);
+  return part_insert(h->part + partof(h, hv), key, hv, value, true);
+}
+
+int hash_lookup(const hashtab_t *h, SEXP key, int ifnotfound)
+{
+  // read only, so may be called from many threads at once provided none is writing to h
+  const uint64_t hv = keyhash(key);
+  const hashpart_t *p = h->part + partof(h, hv);
+  const size_t k = part_slot(p, key, hv);
+  return p->keys[k] ? p->values[k] : ifnotfound;
+}
+
+hashtab_t *hash_build(const SEXP *keys, int n)
+{
+  // each distinct key is mapped to 1+its first position in keys
+  const int nth = getDTthreads(n, true);
+  hashtab_t *h = hash_alloc(nth, MIN(n, 1024*nth));  // start small in case there are few distinct keys
+  if (!h) return NULL; // # nocov
+  // hash each key once and partition the positions by count and scatter, keeping their order within each partition
+  const int nbatch = nth, batchSize = (n-1)/nbatch + 1;
+  uint64_t *hv = malloc(MAX(n, 1)*sizeof(uint64_t));
+  int *rows = malloc(MAX(n, 1)*sizeof(int));
+  int *counts = calloc((size_t)nbatch*nth, sizeof(int));
+  int *partstart = malloc((nth+1)*sizeof(int));
+  bool failed = !hv || !rows || !counts || !partstart;
+  if (!failed) {
+    #pragma omp parallel for num_threads(nth)
+    for (int b=0; b<nbatch; ++b) {
+      int *my_counts = counts + (size_t)b*nth;
+      const int to = MIN(n, (b+1)*batchSize);
+      for (int i=b*batchSize; i<to; ++i) { hv[i] = keyhash(keys[i]); my_counts[partof(h, hv[i])]++; }
+    }
+    for (int p=0, cum=0; p<nth; ++p) {
+      partstart[p] = cum;
+      for (int b=0; b<nbatch; ++b) { const int tmp = counts[(size_t)b*nth+p]; counts[(size_t)b*nth+p] = cum; cum += tmp; }
+    }
+    partstart[nth] = n;
+    #pragma omp parallel for num_threads(nth)
+    for (int b=0; b<nbatch; ++b) {
+      int *my_counts = counts + (size_t)b*nth;
+      const int to = MIN(n, (b+1)*batchSize);
+      for (int i=b*batchSize; i<to; ++i) rows[my_counts[partof(h, hv[i])]++] = i;
+    }
+    // each thread inserts just its partition's keys, in order, so each key is mapped to its first position
+    #pragma omp parallel for num_threads(nth) schedule(static,1)
+    for (int p=0; p<nth; ++p) {
+      hashpart_t *my_part = h->part + p;
+      for (int r=partstart[p]; r<partstart[p+1]; ++r) {
+        const int i = rows[r];
+        if (!part_insert(my_part, keys[i], hv[i], i+1, false)) { failed = true; break; } // # nocov
+      }
+    }
+  }
+  free(hv); free(rows); free(counts); free(partstart);
+  if (failed) { hash_free(h); return NULL; } // # nocov
+  return h;
+}
+
+int hash_keys(const hashtab_t *h, SEXP *out)
+{
+  // the number of distinct keys, and when out isn't NULL the keys themselves in no particular order
+  int n = 0;
+  for (int p=0; p<h->npart; ++p) {
+    const hashpart_t *my_part = h->part + p;
+    if (!out) { n += my_part->n; continue; }
+    for (size_t k=0; k<=my_part->mask; ++k) if (my_part->keys[k]) out[n++] = my_part->keys[k];
+  }
+  return n;
+}
+
+/*
+  A checksum of a column's contents, so that an index saved to disk can be checked against the column it is loaded
+  onto. Rows are hashed in fixed size batches from many threads and the batch hashes are then combined in order, so
+  the result doesn't depend on the number of threads. Not cryptographic: it's to catch a column that has changed
+  since, not one crafted to collide.
+*/
+
+#define COLHASH_BATCH 65536
+
+static inline uint64_t hash_bytes(const char *s, int len)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;  // FNV-1a
+  for (int i=0; i<len; ++i) { h ^= (uint8_t)s[i]; h *= 0x100000001b3ULL; }
+  return mix64(h ^ (uint64_t)len);
+}
+
+static uint64_t colhash_strings(const SEXP *xd, int64_t n)
+{
+  uint64_t h = mix64((uint64_t)n);
+  for (int64_t i=0; i<n; ++i)
+    h = mix64(h ^ (xd[i]==NA_STRING ? 0x9e3779b97f4a7c15ULL : hash_bytes(CHAR(xd[i]), LENGTH(xd[i]))));
+  return h;
+}
+
+SEXP colhash(SEXP x)
+{
+  if (!isVectorAtomic(x))
+    internal_error(__func__, "passed type %s which is not an atomic vector", type2char(TYPEOF(x))); // # nocov
+  const int64_t n = xlength(x);
+  const int64_t nbatch = (n-1)/COLHASH_BATCH + 1;
+  uint64_t *bh = (uint64_t *)R_alloc(nbatch, sizeof(uint64_t));
+  const char *bytes = NULL;
+  size_t size = 0;
+  const SEXP *xs = NULL;
+  switch (TYPEOF(x)) {
+  case LGLSXP: case INTSXP: case REALSXP: case CPLXSXP: case RAWSXP:
+    bytes = (const char *)DATAPTR_RO(x); size = SIZEOF(x); break;
+  case STRSXP:
+    xs = STRING_PTR_RO(x); break;
+  default:
+    internal_error(__func__, "unsupported type '%s'", type2char(TYPEOF(x))); // # nocov
+  }
+  #pragma omp parallel for num_threads(getDTthreads(nbatch, false))
+  for (int64_t b=0; b<nbatch; ++b) {
+    const int64_t from = b*COLHASH_BATCH, len = MIN(COLHASH_BATCH, n-from);
+    bh[b] = xs ? colhash_strings(xs+from, len) : hash_bytes(bytes + from*size, (int)(len*size));
+  }
+  uint64_t h = mix64((uint64_t)TYPEOF(x) ^ ((uint64_t)n << 8));
+  for (int64_t b=0; b<nbatch; ++b) h = mix64(h ^ bh[b]);
+  if (isFactor(x)) {
+    SEXP levels = getAttrib(x, R_LevelsSymbol);
+    h = mix64(h ^ colhash_strings(STRING_PTR_RO(levels), xlength(levels)));
+  }
+  char buff[17];
+  snprintf(buff, 17, "%08x%08x", (unsigned)(h>>32), (unsigned)(h&0xffffffff));
+  return mkString(buff);
+}
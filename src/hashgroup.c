@@ -0,0 +1,230 @@
+#include "data.table.h"
+
+/*
+  Finding groups by hashing rather than sorting, for by= (not keyby=) where the groups are wanted in order of first
+  appearance anyway. The result is what [.data.table uses from forderv(byval, sort=FALSE, retGrp=TRUE) followed by
+  reordering the groups back to first appearance: an ordering vector o (integer() when the rows are already grouped in
+  order of appearance) with attributes starts and maxgrpn, where groups are in order of first appearance and the rows
+  within each group are in their original order. So f__, len__ and o__ for dogroups and gforce are unchanged.
+
+  A radix sort costs several passes over each by= column plus the gather of the ordering vector, which is what makes
+  high-cardinality composite keys slow. Here each row is hashed once, the rows are partitioned by the top bits of
+  their hash so that each thread can build an open addressing table for its partitions independently, and the groups
+  are then numbered in order of first appearance with one pass. Keys are compared exactly, so hash collisions only
+  cost time. Doubles are compared via dtwiddle() so that -0 and 0, and rounding by setNumericRounding(), agree with
+  forder; NA and NaN are distinct groups, as in forder.
+
+  NULL is returned when a column's type is not supported, or when not forced and a small sample suggests low
+  cardinality where forder is faster; the caller then uses forderv().
+*/
+
+#define HASHGROUP_MINROWS 100000   // below this the choice doesn't matter
+#define HASHGROUP_SAMPLE  4096
+
+uint64_t mix64(uint64_t h)
+{
+  // splitmix64 finalizer; also used by guniqueN's HyperLogLog
+  h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+// the by= columns, resolved up front so that no R API is called from the threads
+typedef struct {
+  enum {HG_INT, HG_DOUBLE, HG_INT64, HG_COMPLEX, HG_STRING} type;
+  const void *p;
+} hgcol_t;
+
+static inline uint64_t colkey(const hgcol_t *x, int i)
+{
+  switch(x->type) {
+  case HG_INT:     return (uint32_t)((const int *)x->p)[i];
+  case HG_DOUBLE:  return dtwiddle(((const double *)x->p)[i]);
+  case HG_INT64:   return (uint64_t)((const int64_t *)x->p)[i];
+  case HG_COMPLEX: return dtwiddle(((const Rcomplex *)x->p)[i].r) * 0x9e3779b97f4a7c15ULL + dtwiddle(((const Rcomplex *)x->p)[i].i);
+  default:         return (uint64_t)(uintptr_t)((const SEXP *)x->p)[i];
+  }
+}
+
+static inline bool colequal(const hgcol_t *x, int a, int b)
+{
+  switch(x->type) {
+  case HG_INT:     return ((const int *)x->p)[a]==((const int *)x->p)[b];
+  case HG_INT64:   return ((const int64_t *)x->p)[a]==((const int64_t *)x->p)[b];
+  case HG_COMPLEX: return dtwiddle(((const Rcomplex *)x->p)[a].r)==dtwiddle(((const Rcomplex *)x->p)[b].r) && dtwiddle(((const Rcomplex *)x->p)[a].i)==dtwiddle(((const Rcomplex *)x->p)[b].i);
+  case HG_STRING:  return ((const SEXP *)x->p)[a]==((const SEXP *)x->p)[b];
+  default:         return dtwiddle(((const double *)x->p)[a])==dtwiddle(((const double *)x->p)[b]);
+  }
+}
+
+static inline uint64_t rowhash(const hgcol_t *cols, int ncol, int i)
+{
+  uint64_t h = 0;
+  for (int j=0; j<ncol; ++j) h = mix64(h ^ colkey(cols+j, i));
+  return h;
+}
+
+static bool hashable(SEXP x, hgcol_t *col)
+{
+  switch(TYPEOF(x)) {
+  case LGLSXP: case INTSXP:
+    col->type = HG_INT; col->p = INTEGER_RO(x);
+    return true;
+  case REALSXP:
+    col->type = INHERITS(x, char_integer64) ? HG_INT64 : HG_DOUBLE; col->p = REAL_RO(x);
+    return true;
+  case CPLXSXP:
+    col->type = HG_COMPLEX; col->p = COMPLEX_RO(x);
+    return true;
+  case STRSXP: {
+    // CHARSXP are compared by address, which is only the same as comparing the strings when none need translating to UTF-8
+    const SEXP *xd = STRING_PTR_RO(x);
+    for (int i=0; i<LENGTH(x); ++i) if (NEED2UTF8(xd[i])) return false;
+    col->type = HG_STRING; col->p = xd;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+SEXP hashgroup(SEXP l, SEXP forceArg)
+{
+  if (!isNewList(l) || !length(l)) internal_error(__func__, "l is not a non-empty list of columns"); // # nocov
+  if (!isLogical(forceArg) || LENGTH(forceArg)!=1) internal_error(__func__, "force is not TRUE, FALSE or NA"); // # nocov
+  const bool force = LOGICAL(forceArg)[0]==TRUE;
+  const int ncol = length(l), nrow = length(VECTOR_ELT(l, 0));
+  if (!force && nrow<HASHGROUP_MINROWS) return R_NilValue;
+  hgcol_t *cols = (hgcol_t *)R_alloc(ncol, sizeof(hgcol_t));
+  for (int j=0; j<ncol; ++j) {
+    if (length(VECTOR_ELT(l, j))!=nrow) internal_error(__func__, "column %d is length %d but column 1 is length %d", j+1, length(VECTOR_ELT(l, j)), nrow); // # nocov
+    if (!hashable(VECTOR_ELT(l, j), cols+j)) return R_NilValue;
+  }
+  double started = wallclock();
+  const bool verbose = GetVerbose();
+
+  if (!force) {
+    // estimate the proportion of distinct keys from an evenly spaced sample, hashing only the sampled rows so that
+    // low cardinality keys, which go to forder, don't pay for hashing every row first
+    uint64_t tab[2*HASHGROUP_SAMPLE];
+    memset(tab, 0, sizeof(tab));
+    const int m = HASHGROUP_SAMPLE, step = nrow/m;
+    int ndistinct = 0;
+    for (int s=0; s<m; ++s) {
+      const uint64_t h = rowhash(cols, ncol, s*step) | 1;  // | 1 so that 0 marks an empty slot
+      int k = h & (2*m-1);
+      while (tab[k] && tab[k]!=h) k = (k+1) & (2*m-1);
+      if (!tab[k]) { tab[k] = h; ndistinct++; }
+    }
+    if (verbose) Rprintf(_("hashgroup sampled %d distinct keys in %d rows\n"), ndistinct, m);
+    if (ndistinct < m/2) return R_NilValue;
+  }
+
+  uint64_t *hash = (uint64_t *)R_alloc(nrow, sizeof(uint64_t));
+  #pragma omp parallel for num_threads(getDTthreads(nrow, true))
+  for (int i=0; i<nrow; ++i) hash[i] = rowhash(cols, ncol, i);
+
+  // partition the rows by the top bits of their hash, keeping row order within each partition
+  const int nth = getDTthreads(nrow, true);
+  int pbits = 0;
+  while ((1<<pbits) < 8*nth && pbits<10) pbits++;
+  const int npart = 1<<pbits;
+  const int nbatch = nth;
+  const int batchSize = (nrow-1)/nbatch + 1;
+  int *counts = (int *)R_alloc((size_t)nbatch*npart, sizeof(int));
+  memset(counts, 0, (size_t)nbatch*npart*sizeof(int));
+  #pragma omp parallel for num_threads(nth)
+  for (int b=0; b<nbatch; ++b) {
+    int *my_counts = counts + (size_t)b*npart;
+    const int to = MIN(nrow, (b+1)*batchSize);
+    for (int i=b*batchSize; i<to; ++i) my_counts[ pbits ? hash[i]>>(64-pbits) : 0 ]++;
+  }
+  int *partstart = (int *)R_alloc(npart+1, sizeof(int));
+  for (int p=0, cum=0; p<npart; ++p) {
+    partstart[p] = cum;
+    for (int b=0; b<nbatch; ++b) { const int tmp = counts[(size_t)b*npart+p]; counts[(size_t)b*npart+p] = cum; cum += tmp; }
+  }
+  partstart[npart] = nrow;
+  int *rows = (int *)R_alloc(nrow, sizeof(int));
+  #pragma omp parallel for num_threads(nth)
+  for (int b=0; b<nbatch; ++b) {
+    int *my_counts = counts + (size_t)b*npart;
+    const int to = MIN(nrow, (b+1)*batchSize);
+    for (int i=b*batchSize; i<to; ++i) rows[ my_counts[ pbits ? hash[i]>>(64-pbits) : 0 ]++ ] = i;
+  }
+  if (verbose) { Rprintf(_("hashgroup hashing and partitioning took %.3fs\n"), wallclock()-started); started=wallclock(); }
+
+  // within each partition, the i-th new key found gets provisional group partstart[p]+i, so provisional groups are unique
+  // across partitions and within [0,nrow) without a further pass; first[] holds the row each was first seen in
+  int *grp = (int *)R_alloc(nrow, sizeof(int));
+  int *first = (int *)R_alloc(nrow, sizeof(int));
+  bool failed = false;
+  #pragma omp parallel for num_threads(nth) schedule(dynamic)
+  for (int p=0; p<npart; ++p) {
+    const int from = partstart[p], n = partstart[p+1]-from;
+    if (n==0 || failed) continue;
+    size_t cap = 2;
+    while (cap < 2*(size_t)n) cap <<= 1;
+    int *table = malloc(cap*sizeof(int));  // provisional group, -1 is empty
+    if (!table) { failed = true; continue; } // # nocov
+    for (size_t k=0; k<cap; ++k) table[k] = -1;
+    int ng = from;
+    for (int r=from; r<from+n; ++r) {
+      const int i = rows[r];
+      size_t k = hash[i] & (cap-1);
+      int g;
+      while ((g=table[k])!=-1) {
+        const int f = first[g];
+        if (hash[f]==hash[i]) {
+          int j=0;
+          while (j<ncol && colequal(cols+j, f, i)) j++;
+          if (j==ncol) break;
+        }
+        k = (k+1) & (cap-1);
+      }
+      if (g==-1) { g = table[k] = ng++; first[g] = i; }
+      grp[i] = g;
+    }
+    free(table);
+  }
+  if (failed) error(_("Failed to allocate hash table for hashgroup; try options(datatable.hashgroup=FALSE)")); // # nocov
+  if (verbose) { Rprintf(_("hashgroup building hash tables took %.3fs\n"), wallclock()-started); started=wallclock(); }
+
+  // number the groups in order of first appearance, then place the rows of each group in row order
+  int *newid = first;  // reuse
+  for (int i=0; i<nrow; ++i) newid[i] = -1;
+  int ngrp = 0;
+  int *size = (int *)R_alloc(nrow, sizeof(int));
+  for (int i=0; i<nrow; ++i) {
+    int g = newid[grp[i]];
+    if (g==-1) { g = newid[grp[i]] = ngrp; size[ngrp++] = 0; }
+    grp[i] = g;
+    size[g]++;
+  }
+  SEXP starts = PROTECT(allocVector(INTSXP, ngrp));
+  int *ss = INTEGER(starts), maxgrpn = 0;
+  for (int g=0, cum=0; g<ngrp; ++g) {
+    ss[g] = cum+1;
+    cum += size[g];
+    if (size[g]>maxgrpn) maxgrpn = size[g];
+    size[g] = cum-size[g];  // now the next position to write in group g
+  }
+  bool grouped = true;
+  SEXP ans = PROTECT(allocVector(INTSXP, nrow));
+  int *ansd = INTEGER(ans);
+  for (int i=0; i<nrow; ++i) {
+    const int pos = size[grp[i]]++;
+    ansd[pos] = i+1;
+    grouped &= pos==i;
+  }
+  if (grouped) {
+    // data is already grouped in order of appearance, integer() returned with group sizes attached, as forder
+    UNPROTECT(1);
+    ans = PROTECT(allocVector(INTSXP, 0));
+  }
+  setAttrib(ans, sym_starts, starts);
+  setAttrib(ans, sym_maxgrpn, ScalarInteger(maxgrpn));
+  if (verbose) Rprintf(_("hashgroup found %d groups in %d rows; ordering rows by group took %.3fs\n"), ngrp, nrow, wallclock()-started);
+  UNPROTECT(2);
+  return ans;
+}
@@ -26,6 +26,7 @@ SEXP char_maxString;
 SEXP char_AsIs;
 SEXP sym_sorted;
 SEXP sym_index;
+SEXP sym_bitmap;
 SEXP sym_BY;
 SEXP sym_starts, char_starts;
 SEXP sym_maxgrpn;
@@ -79,6 +80,10 @@ R_CallMethodDef callMethods[] = {
 {"Cfcast", (DL_FUNC) &fcast, -1},
 {"Cuniqlist", (DL_FUNC) &uniqlist, -1},
 {"Cuniqlengths", (DL_FUNC) &uniqlengths, -1},
+{"Chashgroup", (DL_FUNC) &hashgroup, -1},
+{"Ccolhash", (DL_FUNC) &colhash, -1},
+{"CbitmapBuild", (DL_FUNC) &bitmapBuild, -1},
+{"CbitmapWhich", (DL_FUNC) &bitmapWhich, -1},
 {"CforderReuseSorting", (DL_FUNC) &forderReuseSorting, -1},
 {"Cforder", (DL_FUNC) &forder, -1},
 {"Cissorted", (DL_FUNC) &issorted, -1},
@@ -107,6 +112,14 @@ R_CallMethodDef callMethods[] = {
 {"Csetlevels", (DL_FUNC) &setlevels, -1},
 {"Crleid", (DL_FUNC) &rleid, -1},
 {"Cgmedian", (DL_FUNC) &gmedian, -1},
+{"Cgquantile", (DL_FUNC) &gquantile, -1},
+{"CguniqueN", (DL_FUNC) &guniqueN, -1},
+{"Cgnative", (DL_FUNC) &gnative, -1},
+{"Cgfroll", (DL_FUNC) &gfroll, -1},
+{"Cgcum", (DL_FUNC) &gcum, -1},
+{"Cgrank", (DL_FUNC) &grank, -1},
+{"Cgtopk", (DL_FUNC) &gtopk, -1},
+{"CgroupfunRegistered", (DL_FUNC) &groupfunRegistered, -1},
 {"Cgtail", (DL_FUNC) &gtail, -1},
 {"Cghead", (DL_FUNC) &ghead, -1},
 {"Cglast", (DL_FUNC) &glast, -1},
@@ -144,6 +157,8 @@ R_CallMethodDef callMethods[] = {
 {"C_allNAR", (DL_FUNC) &allNAR, -1},
 {"CcoerceAs", (DL_FUNC) &coerceAs, -1},
 {"Ctest_dt_win_snprintf", (DL_FUNC)&test_dt_win_snprintf, -1},
+{"Ctest_sumsq", (DL_FUNC)&test_sumsq, -1},
+{"Ctest_register_groupfun", (DL_FUNC)&test_register_groupfun, -1},
 {"Cdt_zlib_version", (DL_FUNC)&dt_zlib_version, -1},
 {"Cdt_has_zlib", (DL_FUNC)&dt_has_zlib, -1},
 {"Csubstitute_call_arg_namesR", (DL_FUNC) &substitute_call_arg_namesR, -1},
@@ -180,6 +195,7 @@ void attribute_visible R_init_data_table(DllInfo *info)
   // must be also listed in inst/include/datatableAPI.h
   // for end user documentation see ?cdt
   R_RegisterCCallable("data.table", "DT_subsetDT", (DL_FUNC) &subsetDT);
+  R_RegisterCCallable("data.table", "DT_register_groupfun", (DL_FUNC) &DT_register_groupfun);
 
   R_registerRoutines(info, NULL, callMethods, NULL, externalMethods);
   R_useDynamicSymbols(info, FALSE);
@@ -284,6 +300,7 @@ void attribute_visible R_init_data_table(DllInfo *info)
   // keeps the code neat and readable. Also see grep's added to CRAN_Release.cmd to find such calls.
   sym_sorted  = install("sorted");
   sym_index   = install("index");
+  sym_bitmap  = install("bitmap");
   sym_BY      = install(".BY");
   sym_maxgrpn = install("maxgrpn");
   sym_anyna   = install("anyna");
@@ -335,6 +352,12 @@ int GetVerbose(void) {
   return INTEGER(opt)[0];
 }
 
+bool GetDeterministic(void) {
+  // options(datatable.deterministic=TRUE): floating point sums in GForce, froll and fastmean give the same bits on all platforms
+  SEXP opt = GetOption(install("datatable.deterministic"), R_NilValue);
+  return isLogical(opt) && LENGTH(opt)==1 && LOGICAL(opt)[0]==TRUE;
+}
+
 // # nocov start
 SEXP hasOpenMP(void) {
 
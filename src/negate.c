@@ -6,6 +6,7 @@ void negateByRef(SEXP x) {
   }
   const int n = length(x);
   Rboolean *ansd = (Rboolean *)LOGICAL(x);
+  #pragma omp parallel for num_threads(getDTthreads(n, true))
   for(int i=0; i<n; ++i) {
     ansd[i] ^= (ansd[i] != NA_LOGICAL);  // invert true/false but leave NA alone
   }
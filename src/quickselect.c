@@ -6,10 +6,9 @@ static inline void iswap(int *a, int *b)           {int     tmp=*a; *a=*b; *b=tm
 static inline void dswap(double *a, double *b)     {double  tmp=*a; *a=*b; *b=tmp;}
 static inline void i64swap(int64_t *a, int64_t *b) {int64_t tmp=*a; *a=*b; *b=tmp;}
 
-#undef BODY
-#define BODY(SWAP)                          \
-  if (n==0) return NA_REAL;                 \
-  int med = n/2 - (n%2==0);                 \
+// partially sort x so that x[k] is the (k+1)-th smallest, x[0..k-1]<=x[k] and x[k+1..n-1]>=x[k]
+#undef SELECT
+#define SELECT(SWAP)                        \
   unsigned long ir=n-1, l=0;                \
   for(;;) {                                 \
     if (ir <= l+1) {                        \
@@ -39,16 +38,22 @@ static inline void i64swap(int64_t *a, int64_t *b) {int64_t tmp=*a; *a=*b; *b=tm
       }                                     \
       x[l+1]=x[j];                          \
       x[j]=a;                               \
-      if (j >= med) ir=j-1;                 \
-      if (j <= med) l=i;                    \
+      if (j >= k) ir=j-1;                   \
+      if (j <= k) l=i;                      \
     }                                       \
-  }                                         \
-  a = x[med];                               \
+  }
+
+#undef BODY
+#define BODY(SWAP)                          \
+  if (n==0) return NA_REAL;                 \
+  const unsigned long k = n/2 - (n%2==0);   \
+  SELECT(SWAP)                              \
+  a = x[k];                                 \
   if (n%2 == 1) {                           \
     return (double)a;                       \
   } else {                                  \
-    b = x[med+1];                           \
-    for (int i=med+2; i<n; ++i) {           \
+    b = x[k+1];                             \
+    for (int i=k+2; i<n; ++i) {             \
       if (x[i]<b) b=x[i];                   \
     }                                       \
     return ((double)a+(double)b)/2.0;       \
@@ -69,3 +74,31 @@ double i64quickselect(int64_t *x, int n) {
   BODY(i64swap);
 }
 
+// quantile type 7, the default of stats::quantile, at probability p: interpolates between the order statistics either side of
+// 1+(n-1)*p (1-based), with the same arithmetic as stats::quantile so that results are identical
+#undef QBODY
+#define QBODY(SWAP)                         \
+  if (n==0) return NA_REAL;                 \
+  const double index = 1 + (n-1)*p;         \
+  const double lo = floor(index);           \
+  const unsigned long k = (unsigned long)lo - 1; \
+  SELECT(SWAP)                              \
+  a = x[k];                                 \
+  if (index==lo) return (double)a;          \
+  b = x[k+1];                               \
+  for (int i=k+2; i<n; ++i) {               \
+    if (x[i]<b) b=x[i];                     \
+  }                                         \
+  if (b==a) return (double)a;               \
+  const double h = index-lo;                \
+  return (1-h)*(double)a + h*(double)b;
+
+double dquantile(double *x, int n, double p) {
+  double a, b;
+  QBODY(dswap);
+}
+
+double iquantile(int *x, int n, double p) {
+  int a, b;
+  QBODY(iswap);
+}
@@ -87,3 +87,27 @@ SEXP testMsgR(SEXP status, SEXP x, SEXP k) {
   UNPROTECT(protecti);
   return ans;
 }
+
+/*
+  Also for internal tests: a .Call routine, the sum of squares of a numeric vector, and a thread-safe variant of it
+  which the tests register via test_register_groupfun() to exercise DT_register_groupfun and GForce's gnative.
+*/
+static double test_sumsq_group(const double **x, int ncol, int n) {
+  double s = 0.0;
+  for (int j=0; j<ncol; ++j) for (int i=0; i<n; ++i) s += x[j][i]*x[j][i];
+  return s;
+}
+
+SEXP test_sumsq(SEXP x) {
+  if (!isInteger(x) && !isLogical(x) && !isReal(x)) internal_error(__func__, "x must be integer, logical or double"); // # nocov
+  const int n = length(x);
+  double *tmp = (double *)R_alloc(n, sizeof(double));
+  for (int i=0; i<n; ++i) tmp[i] = isReal(x) ? REAL(x)[i] : (INTEGER(x)[i]==NA_INTEGER ? NA_REAL : INTEGER(x)[i]);
+  const double *p = tmp;
+  return ScalarReal(test_sumsq_group(&p, 1, n));
+}
+
+SEXP test_register_groupfun(void) {
+  DT_register_groupfun("data_table", "Ctest_sumsq", test_sumsq_group);
+  return R_NilValue;
+}